@@ -0,0 +1,229 @@
+/*
+ * Heap allocations of the request path of the servers
+ *
+ * Counts the calls to operator new while an in-process tcp_server and udp_server answer queries that do not reach
+ * the hub, one at a time - and a batch of framed queries, in one write. The clients use plain sockets and fixed
+ * buffers, so every allocation counted is the server's. After a warm-up, a steady-state request must not allocate:
+ * exits with 1 when one does.
+ *
+ * e.g. ./alloc_bench_exe -n 20000
+ */
+#include <iostream>
+#include <thread>
+#include <atomic>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <new>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <boost/asio.hpp>
+
+#include "database.hpp"
+#include "async_server.hpp"
+
+#define BENCH_PORT 18780
+#define BENCH_DESKS 3
+#define BENCH_SAMPLES 1000 // per desk, before the queries
+#define DEFAULT_REQUESTS 20000
+#define WARM_UP_REQUESTS 200
+
+static std::atomic<uint64_t> g_allocations{0};
+
+void *operator new(size_t size)
+{
+    g_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *pointer = std::malloc(size ? size : 1);
+    if (!pointer)
+    {
+        throw std::bad_alloc();
+    }
+    return pointer;
+}
+
+void *operator new[](size_t size)
+{
+    return operator new(size);
+}
+
+void operator delete(void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+void operator delete[](void *pointer) noexcept
+{
+    std::free(pointer);
+}
+
+/*
+ * Swallows what the server prints, still formatting it
+ */
+class null_buffer : public std::streambuf
+{
+protected:
+    int overflow(int c) override { return c; }
+};
+
+static int open_client(int type, unsigned short port, sockaddr_in *address)
+{
+    int fd = socket(AF_INET, type, 0);
+    std::memset(address, 0, sizeof(*address));
+    address->sin_family = AF_INET;
+    address->sin_port = htons(port);
+    address->sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    if (type == SOCK_STREAM && connect(fd, (sockaddr *)address, sizeof(*address)) != 0)
+    {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/*
+ * Sends <query> <n> times, waiting for each answer - <lines> lines over TCP
+ */
+static bool ask(int fd, int type, const sockaddr_in &address, const char *query, size_t lines, size_t n)
+{
+    char answer[REPLY_BUFFER_BYTES];
+
+    for (size_t i = 0; i < n; i++)
+    {
+        if (type == SOCK_STREAM)
+        {
+            if (send(fd, query, std::strlen(query), 0) <= 0)
+            {
+                return false;
+            }
+            size_t n_lines = 0;
+            while (n_lines < lines) // until the end of the last line
+            {
+                ssize_t r = recv(fd, answer, sizeof(answer), 0);
+                if (r <= 0)
+                {
+                    return false;
+                }
+                n_lines += std::count(answer, answer + r, '\n');
+            }
+        }
+        else
+        {
+            sendto(fd, query, std::strlen(query), 0, (const sockaddr *)&address, sizeof(address));
+            if (recv(fd, answer, sizeof(answer), 0) <= 0)
+            {
+                return false;
+            }
+        }
+    }
+    return true;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n_requests = DEFAULT_REQUESTS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_requests = std::strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-n requests]" << std::endl;
+            return 1;
+        }
+    }
+
+    struct query
+    {
+        int type;
+        const char *text;
+        size_t lines; // of the answer
+        uint64_t allocations;
+    } queries[] = {
+        {SOCK_STREAM, "0ge", 1, 0},
+        {SOCK_STREAM, "2gp", 1, 0},
+        {SOCK_STREAM, "1gl", 1, 0},
+        {SOCK_STREAM, "0gf 60.000000", 1, 0},
+        {SOCK_STREAM, "2gS l", 1, 0},
+        {SOCK_STREAM, "0gAe", 1, 0},
+        {SOCK_STREAM, "0gT", BENCH_DESKS + 3, 0}, // the table of every desk
+        {SOCK_STREAM, "9gl", 1, 0},               // unknown desk
+        {SOCK_DGRAM, "b l 9", 1, 0},              // unknown desk
+        {SOCK_STREAM, "#1 0ge\n#2 2gp\n#3 1gl\n#4 0gf 60.000000\n#5 2gS l\n#6 0gAe\n#7 9gl\n#8 3go\n", 8, 0}, // framed, on its own connection
+    };
+
+    null_buffer sink;
+    std::streambuf *out = std::cout.rdbuf(&sink);
+    bool ok = true;
+    {
+        boost::asio::io_context io;
+        office the_office{BENCH_DESKS};
+        tcp_server the_tcp{&io, BENCH_PORT, &the_office, nullptr}; // the queries never reach the hub
+        udp_server the_udp{&io, BENCH_PORT + 1, &the_office};
+
+        for (int s = 0; s < BENCH_SAMPLES; s++)
+        {
+            for (int d = 1; d <= BENCH_DESKS; d++)
+            {
+                char frame[6] = {'s', (char)d};
+                u_int8_t val[2]{};
+                the_office.float_2_bytes(50.0f + 10.0f * std::sin(0.01f * s + d), val);
+                frame[2] = (char)val[1];
+                frame[3] = (char)val[0];
+                the_office.float_2_bytes(40.0f, val);
+                frame[4] = (char)val[1];
+                frame[5] = (char)val[0];
+                the_office.updates_database(frame, 6);
+            }
+        }
+
+        std::thread server{[&io]() { io.run(); }};
+
+        sockaddr_in tcp_address, udp_address;
+        int tcp_fd = open_client(SOCK_STREAM, BENCH_PORT, &tcp_address);
+        int framed_fd = open_client(SOCK_STREAM, BENCH_PORT, &tcp_address);
+        int udp_fd = open_client(SOCK_DGRAM, BENCH_PORT + 1, &udp_address);
+        ok = tcp_fd >= 0 && framed_fd >= 0 && udp_fd >= 0;
+
+        for (size_t q = 0; ok && q < sizeof(queries) / sizeof(queries[0]); q++)
+        {
+            int fd = queries[q].type == SOCK_DGRAM ? udp_fd : queries[q].text[0] == FRAME_TAG ? framed_fd : tcp_fd;
+            const sockaddr_in &address = queries[q].type == SOCK_STREAM ? tcp_address : udp_address;
+
+            ok = ask(fd, queries[q].type, address, queries[q].text, queries[q].lines, WARM_UP_REQUESTS);
+            uint64_t before = g_allocations.load();
+            ok = ok && ask(fd, queries[q].type, address, queries[q].text, queries[q].lines, n_requests);
+            queries[q].allocations = g_allocations.load() - before;
+        }
+
+        close(tcp_fd);
+        close(framed_fd);
+        close(udp_fd);
+        io.stop();
+        server.join();
+    }
+    std::cout.rdbuf(out);
+
+    if (!ok)
+    {
+        std::cout << "The servers did not answer" << std::endl;
+        return 1;
+    }
+
+    bool zero = true;
+    printf("%-22s %10s %12s %12s\n", "query", "requests", "allocations", "per request");
+    for (size_t q = 0; q < sizeof(queries) / sizeof(queries[0]); q++)
+    {
+        const char *text = queries[q].text[0] == FRAME_TAG ? "framed batch of 8" : queries[q].text;
+        printf("%-4s %-17s %10zu %12lu %12.3f\n", queries[q].type == SOCK_STREAM ? "tcp" : "udp", text, n_requests,
+               (unsigned long)queries[q].allocations, (double)queries[q].allocations / n_requests);
+        zero = zero && queries[q].allocations == 0;
+    }
+    return zero ? 0 : 1;
+}
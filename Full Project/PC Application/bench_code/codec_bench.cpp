@@ -0,0 +1,257 @@
+/*
+ * Check and micro-benchmark of the fixed-point codec (server_code/fixed_point.hpp)
+ *
+ * Checks the codec against the float implementations it replaced: every one of the 65536 codes is decoded, random
+ * and boundary numbers are encoded, and every valid code must survive a decode and an encode. Then it reports
+ * ns per encode and per decode of both. Exits with 1 on any mismatch.
+ *
+ * e.g. ./codec_bench_exe -n 10000000
+ */
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <limits>
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+
+#include "fixed_point.hpp"
+
+#define DEFAULT_VALUES 10000000
+#define FUZZ_VALUES 2000000
+
+/* --------------------------------------------------------------------------------
+   |                    Previous implementations, the reference                   |
+   -------------------------------------------------------------------------------- */
+
+static uint16_t legacy_12_4_encode(float fnum)
+{
+    fnum = fnum < pow(2, 12) - 0.05 ? fnum : pow(2, 12) - 1 + 0.9;
+
+    uint16_t output = fnum < 0;
+    uint16_t inum = fnum;
+    fnum = fnum - inum;
+    uint8_t dnum = round(10 * fnum);
+
+    if (dnum == 10)
+    {
+        dnum = 0;
+        inum++;
+    }
+
+    inum = inum << 4;
+    output = output ? 15 : inum + dnum;
+    return output;
+}
+
+static float legacy_12_4_decode(uint8_t most_significative_bit, uint8_t less_significative_bit)
+{
+    float decimal_number = less_significative_bit & 0xF;
+    float integer_number = (most_significative_bit << 4) + ((less_significative_bit & 0xF0) >> 4);
+
+    if (decimal_number == 15.0)
+    {
+        return decimal_number * 0.01;
+    }
+    return integer_number + decimal_number * 0.1;
+}
+
+static uint16_t legacy_9_7_encode(float fnum)
+{
+    fnum = fnum < pow(2, 9) - 0.005 ? fnum : pow(2, 9) - 1 + 0.99;
+
+    uint16_t output = fnum < 0;
+    uint16_t inum = fnum;
+    fnum = fnum - inum;
+    uint8_t dnum = round(100 * fnum);
+
+    if (dnum == 100)
+    {
+        dnum = 0;
+        inum++;
+    }
+
+    inum = inum << 7;
+    output = output ? 127 : inum + dnum;
+    return output;
+}
+
+static float legacy_9_7_decode(uint8_t most_significative_bit, uint8_t less_significative_bit)
+{
+    int decimal_int = less_significative_bit & 0x7F;
+    int integer = (most_significative_bit << 1) + ((less_significative_bit & 0x80) >> 7);
+    return integer + decimal_int / 100.0;
+}
+
+/* --------------------------------------------------------------------------------
+   |                                   Checks                                     |
+   -------------------------------------------------------------------------------- */
+
+static bool same(float a, float b)
+{
+    return std::memcmp(&a, &b, sizeof(float)) == 0;
+}
+
+static size_t check_decode()
+{
+    size_t errors = 0;
+    for (uint32_t raw = 0; raw <= 0xFFFF; raw++)
+    {
+        if (!same(fixed_12_4_decode(raw), legacy_12_4_decode(raw >> 8, raw & 0xFF)))
+        {
+            if (errors++ < 10)
+                std::cout << "12.4 decode of " << raw << ": " << fixed_12_4_decode(raw) << " != " << legacy_12_4_decode(raw >> 8, raw & 0xFF) << std::endl;
+        }
+        if (!same(fixed_9_7_decode(raw), legacy_9_7_decode(raw >> 8, raw & 0xFF)))
+        {
+            if (errors++ < 10)
+                std::cout << "9.7 decode of " << raw << ": " << fixed_9_7_decode(raw) << " != " << legacy_9_7_decode(raw >> 8, raw & 0xFF) << std::endl;
+        }
+    }
+    return errors;
+}
+
+static size_t check_encode(const std::vector<float> &values)
+{
+    size_t errors = 0;
+    for (size_t i = 0; i < values.size(); i++)
+    {
+        if (fixed_12_4_encode(values[i]) != legacy_12_4_encode(values[i]))
+        {
+            if (errors++ < 10)
+                std::cout << "12.4 encode of " << values[i] << ": " << fixed_12_4_encode(values[i]) << " != " << legacy_12_4_encode(values[i]) << std::endl;
+        }
+        if (fixed_9_7_encode(values[i]) != legacy_9_7_encode(values[i]))
+        {
+            if (errors++ < 10)
+                std::cout << "9.7 encode of " << values[i] << ": " << fixed_9_7_encode(values[i]) << " != " << legacy_9_7_encode(values[i]) << std::endl;
+        }
+    }
+    return errors;
+}
+
+// every valid code is decoded and encoded back
+static size_t check_round_trip()
+{
+    size_t errors = 0;
+    for (uint32_t raw = 0; raw <= 0xFFFF; raw++)
+    {
+        if ((raw & 0xF) <= 9 && fixed_12_4_encode(fixed_12_4_decode(raw)) != raw)
+        {
+            if (errors++ < 10)
+                std::cout << "12.4 round trip of " << raw << ": " << fixed_12_4_encode(fixed_12_4_decode(raw)) << std::endl;
+        }
+        if ((raw & 0x7F) <= 99 && fixed_9_7_encode(fixed_9_7_decode(raw)) != raw)
+        {
+            if (errors++ < 10)
+                std::cout << "9.7 round trip of " << raw << ": " << fixed_9_7_encode(fixed_9_7_decode(raw)) << std::endl;
+        }
+    }
+    return errors;
+}
+
+static std::vector<float> fuzz_values(size_t n)
+{
+    std::vector<float> values;
+    std::mt19937 generator(2021);
+    std::uniform_real_distribution<float> wide(-10.0f, 5000.0f);
+    std::uniform_real_distribution<float> narrow(0.0f, 600.0f);
+    std::uniform_int_distribution<uint32_t> bits;
+
+    for (size_t i = 0; i < n; i++)
+    {
+        values.push_back(wide(generator));
+        values.push_back(narrow(generator));
+
+        uint32_t raw = bits(generator); // any float, NaN and infinities included
+        float any;
+        std::memcpy(&any, &raw, sizeof(any));
+        values.push_back(any);
+    }
+
+    // around the roundings and the limits
+    for (int tenths = 0; tenths <= 41000; tenths++)
+    {
+        float half = (tenths + 0.5f) / 10.0f;
+        values.push_back(half);
+        values.push_back(std::nextafter(half, 0.0f));
+        values.push_back(std::nextafter(half, 5000.0f));
+        values.push_back((tenths + 0.05f) / 10.0f);
+    }
+    float edges[] = {0.0f, -0.0f, -0.01f, 511.99f, 511.995f, 512.0f, 4095.9f, 4095.94f, 4095.95f, 4096.0f, 1e9f,
+                     std::numeric_limits<float>::infinity(), -std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN()};
+    values.insert(values.end(), edges, edges + sizeof(edges) / sizeof(edges[0]));
+    return values;
+}
+
+/* --------------------------------------------------------------------------------
+   |                                 Benchmark                                    |
+   -------------------------------------------------------------------------------- */
+
+template <class F>
+static double ns_per_call(size_t n, F call)
+{
+    auto begin = std::chrono::steady_clock::now();
+    uint32_t sink = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        sink += call(i);
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    volatile uint32_t keep = sink; // the loop can not be optimized away
+    (void)keep;
+    return std::chrono::duration<double, std::nano>(end - begin).count() / n;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n_values = DEFAULT_VALUES;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_values = std::strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-n values]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<float> fuzz = fuzz_values(FUZZ_VALUES);
+    size_t decode_errors = check_decode();
+    size_t encode_errors = check_encode(fuzz);
+    size_t round_trip_errors = check_round_trip();
+
+    printf("%-12s %10s %10s\n", "check", "cases", "errors");
+    printf("%-12s %10u %10zu\n", "decode", 2 * 65536, decode_errors);
+    printf("%-12s %10zu %10zu\n", "encode", 2 * fuzz.size(), encode_errors);
+    printf("%-12s %10u %10zu\n", "round trip", 2 * 65536, round_trip_errors);
+
+    // workload: the values the desks send
+    std::vector<float> values(n_values);
+    std::vector<uint16_t> codes(n_values);
+    std::mt19937 generator(7);
+    std::uniform_real_distribution<float> lux(0.0f, 400.0f);
+    for (size_t i = 0; i < n_values; i++)
+    {
+        values[i] = lux(generator);
+        codes[i] = fixed_12_4_encode(values[i]);
+    }
+
+    printf("\n%-12s %12s %12s\n", "12.4", "legacy ns", "codec ns");
+    printf("%-12s %12.2f %12.2f\n", "encode",
+           ns_per_call(n_values, [&values](size_t i) { return legacy_12_4_encode(values[i]); }),
+           ns_per_call(n_values, [&values](size_t i) { return fixed_12_4_encode(values[i]); }));
+    printf("%-12s %12.2f %12.2f\n", "decode",
+           ns_per_call(n_values, [&codes](size_t i) { float v = legacy_12_4_decode(codes[i] >> 8, codes[i] & 0xFF); uint32_t b; std::memcpy(&b, &v, 4); return b; }),
+           ns_per_call(n_values, [&codes](size_t i) { float v = fixed_12_4_decode(codes[i]); uint32_t b; std::memcpy(&b, &v, 4); return b; }));
+
+    return (decode_errors || encode_errors || round_trip_errors) ? 1 : 0;
+}
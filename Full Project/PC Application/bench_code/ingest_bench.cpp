@@ -0,0 +1,386 @@
+/*
+ * Ingest benchmark of office::updates_database
+ *
+ * Feeds synthetic (or recorded, from a frame log) hub frames straight into the office and reports
+ * frames/s, p50/p99 latency per frame and heap allocations per frame at 3, 16, 64 and 255 desks,
+ * one frame per call and one round of desks per office::updates_database_batch.
+ * With -p the frames also go through communications, over a pseudo-terminal pair, and it reports how many frames
+ * each read of the serial port carries. -t paces the pty writer at that many rounds of samples per second, as the hub.
+ *
+ * e.g. ./ingest_bench_exe -n 200000
+ *      ./ingest_bench_exe -r frame_log
+ *      ./ingest_bench_exe -p
+ *      ./ingest_bench_exe -p -t 100 -n 20000
+ */
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <cmath>
+#include <new>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "database.hpp"
+#include "serial.hpp"
+#include "frame_log.hpp"
+
+#define DEFAULT_FRAMES 200000
+#define CONFIG_FRAME_PERIOD 100 // one set command every 100 rounds of samples
+
+/* --------------------------------------------------------------------------------
+   |                           Allocation counter                                 |
+   -------------------------------------------------------------------------------- */
+
+static std::atomic<uint64_t> n_allocations{0};
+
+void *operator new(size_t size)
+{
+    n_allocations.fetch_add(1, std::memory_order_relaxed);
+    void *p = std::malloc(size ? size : 1);
+    if (!p)
+        throw std::bad_alloc();
+    return p;
+}
+
+void *operator new[](size_t size) { return operator new(size); }
+void operator delete(void *p) noexcept { std::free(p); }
+void operator delete[](void *p) noexcept { std::free(p); }
+void operator delete(void *p, size_t) noexcept { std::free(p); }
+void operator delete[](void *p, size_t) noexcept { std::free(p); }
+
+/* --------------------------------------------------------------------------------
+   |                                 Frames                                       |
+   -------------------------------------------------------------------------------- */
+
+struct frame
+{
+    uint8_t size;
+    char bytes[6];
+};
+
+/*
+ * Writes value as the hub does: the most significative byte first
+ */
+static void put_value(const office &encoder, float value, char *out)
+{
+    u_int8_t val[2]{};
+    encoder.float_2_bytes(value, val);
+    out[0] = (char)val[1];
+    out[1] = (char)val[0];
+}
+
+/*
+ * Rounds of '+s' samples for every desk, with a '+o', '+O' or '+c' every CONFIG_FRAME_PERIOD rounds
+ */
+static std::vector<frame> synthetic_frames(const office &encoder, int desks, size_t n_frames)
+{
+    std::vector<frame> frames;
+    frames.reserve(n_frames);
+
+    const char config_types[] = {'o', 'O', 'c'};
+    size_t round = 0;
+    while (frames.size() < n_frames)
+    {
+        for (int d = 1; d <= desks && frames.size() < n_frames; d++)
+        {
+            frame f{6, {'s', (char)(uint8_t)d}};
+            put_value(encoder, 50.0f + 10.0f * std::sin(0.01f * round + d), &f.bytes[2]);
+            put_value(encoder, 40.0f + 5.0f * std::cos(0.01f * round + d), &f.bytes[4]);
+            frames.push_back(f);
+        }
+
+        if (++round % CONFIG_FRAME_PERIOD == 0 && frames.size() < n_frames)
+        {
+            frame f{4, {config_types[(round / CONFIG_FRAME_PERIOD) % 3], (char)(uint8_t)(1 + round % desks)}};
+            put_value(encoder, f.bytes[0] == 'o' ? (float)(round & 1) : 30.0f, &f.bytes[2]);
+            frames.push_back(f);
+        }
+    }
+    return frames;
+}
+
+static std::vector<frame> recorded_frames(const std::string &directory, int *desks)
+{
+    std::vector<frame> frames;
+    frame_log log{directory};
+    int max_address = 1;
+
+    log.scan([&frames, &max_address](const frame_record &record) {
+        frame f{record.size, {}};
+        std::memcpy(f.bytes, record.frame, record.size);
+        frames.push_back(f);
+        if (f.bytes[0] == 's')
+        {
+            max_address = std::max(max_address, (int)(uint8_t)f.bytes[1]);
+        }
+    });
+
+    *desks = max_address;
+    return frames;
+}
+
+/* --------------------------------------------------------------------------------
+   |                                 Runs                                         |
+   -------------------------------------------------------------------------------- */
+
+struct result
+{
+    double frames_per_second = 0.0;
+    double p50_ns = 0.0;
+    double p99_ns = 0.0;
+    double allocations_per_frame = 0.0;
+    double frames_per_read = 0.0;
+};
+
+// the office greets and says goodbye through std::cout: it is muted while measuring
+static std::streambuf *mute()
+{
+    return std::cout.rdbuf(nullptr);
+}
+
+static void unmute(std::streambuf *buf)
+{
+    std::cout.rdbuf(buf);
+    std::cout.clear();
+}
+
+static result run_direct(int desks, std::vector<frame> &frames)
+{
+    result r;
+    std::vector<uint32_t> latencies(frames.size());
+
+    std::streambuf *out = mute();
+    {
+        office the_office{(uint8_t)desks};
+
+        // throughput and allocations
+        uint64_t allocations = n_allocations.load();
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            the_office.updates_database(frames[i].bytes, frames[i].size);
+        }
+        auto end = std::chrono::steady_clock::now();
+        allocations = n_allocations.load() - allocations;
+
+        // latency of each frame
+        for (size_t i = 0; i < frames.size(); i++)
+        {
+            auto t0 = std::chrono::steady_clock::now();
+            the_office.updates_database(frames[i].bytes, frames[i].size);
+            auto t1 = std::chrono::steady_clock::now();
+            latencies[i] = (uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count();
+        }
+
+        r.frames_per_second = frames.size() / std::chrono::duration<double>(end - begin).count();
+        r.allocations_per_frame = (double)allocations / frames.size();
+    }
+    unmute(out);
+
+    std::sort(latencies.begin(), latencies.end());
+    r.p50_ns = latencies[latencies.size() / 2];
+    r.p99_ns = latencies[latencies.size() * 99 / 100];
+    return r;
+}
+
+/*
+ * Feeds the frames through office::updates_database_batch, one round of samples of every desk per batch as a read
+ * of the serial port at the rate of the hub carries
+ */
+static result run_batch(int desks, std::vector<frame> &frames)
+{
+    result r;
+
+    std::vector<hub_frame> batch(frames.size());
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        batch[i].size = frames[i].size;
+        std::memcpy(batch[i].bytes, frames[i].bytes, frames[i].size);
+    }
+
+    std::streambuf *out = mute();
+    {
+        office the_office{(uint8_t)desks};
+
+        uint64_t allocations = n_allocations.load();
+        auto begin = std::chrono::steady_clock::now();
+        for (size_t i = 0; i < batch.size(); i += desks)
+        {
+            the_office.updates_database_batch(&batch[i], std::min<size_t>(desks, batch.size() - i));
+        }
+        auto end = std::chrono::steady_clock::now();
+        allocations = n_allocations.load() - allocations;
+
+        r.frames_per_second = frames.size() / std::chrono::duration<double>(end - begin).count();
+        r.allocations_per_frame = (double)allocations / frames.size();
+        r.frames_per_read = desks;
+    }
+    unmute(out);
+    return r;
+}
+
+/*
+ * Writes the frames on the master side of a pty while communications reads the slave side
+ */
+static result run_pty(int desks, std::vector<frame> &frames, int rate)
+{
+    result r;
+
+    int master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        std::cout << "Could not open a pseudo-terminal" << std::endl;
+        return r;
+    }
+    std::string slave = ptsname(master);
+
+    // the whole stream, as the hub sends it
+    std::string stream;
+    for (size_t i = 0; i < frames.size(); i++)
+    {
+        stream += '+';
+        stream.append(frames[i].bytes, frames[i].size);
+    }
+
+    std::streambuf *out = mute();
+    {
+        boost::asio::io_context io;
+        office the_office{(uint8_t)desks};
+        communications the_serial{&io, slave};
+
+        the_serial.read_frames_asynchronous(&the_office);
+        std::thread reader{[&io]() { io.run(); }};
+
+        uint64_t allocations = n_allocations.load();
+        auto begin = std::chrono::steady_clock::now();
+
+        std::thread writer{[master, &stream, desks, rate]() {
+            size_t chunk = rate ? (1 + FRAME_MAX_BYTES) * desks : 4096; // paced: one round of samples at a time
+            size_t sent = 0;
+            while (sent < stream.size())
+            {
+                ssize_t n = write(master, stream.data() + sent, std::min<size_t>(chunk, stream.size() - sent));
+                if (n <= 0)
+                    break;
+                sent += n;
+                if (rate)
+                    std::this_thread::sleep_for(std::chrono::microseconds(1000000 / rate));
+            }
+        }};
+
+        // waits until every frame is processed, or the reader stops making progress
+        uint64_t processed = 0;
+        auto last_progress = std::chrono::steady_clock::now();
+        while (the_office.get_num_frames() < frames.size())
+        {
+            std::this_thread::sleep_for(std::chrono::microseconds(100));
+            if (the_office.get_num_frames() != processed)
+            {
+                processed = the_office.get_num_frames();
+                last_progress = std::chrono::steady_clock::now();
+            }
+            else if (std::chrono::steady_clock::now() - last_progress > std::chrono::seconds(5))
+            {
+                break;
+            }
+        }
+        auto end = std::chrono::steady_clock::now();
+        processed = the_office.get_num_frames();
+        allocations = n_allocations.load() - allocations;
+
+        writer.join();
+        the_serial.set_coms_not_available();
+        io.stop();
+        reader.join();
+
+        r.frames_per_second = processed / std::chrono::duration<double>(end - begin).count();
+        r.allocations_per_frame = processed ? (double)allocations / processed : 0.0;
+        r.frames_per_read = the_serial.get_num_reads() ? (double)processed / the_serial.get_num_reads() : 0.0;
+    }
+    unmute(out);
+
+    close(master);
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    size_t n_frames = DEFAULT_FRAMES;
+    std::string recording;
+    bool through_pty = false;
+    int rate = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:pt:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_frames = std::strtoul(optarg, nullptr, 10);
+            break;
+        case 'r':
+            recording = optarg;
+            break;
+        case 'p':
+            through_pty = true;
+            break;
+        case 't':
+            rate = std::max(0, std::atoi(optarg));
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-n frames] [-r frame_log_directory] [-p] [-t rounds per second]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::vector<int> desk_counts{3, 16, 64, 255};
+    std::vector<std::vector<frame>> workloads;
+
+    if (!recording.empty())
+    {
+        int desks = 0;
+        workloads.push_back(recorded_frames(recording, &desks));
+        desk_counts.assign(1, desks);
+        if (workloads.back().empty())
+        {
+            std::cout << "There are no frames recorded at '" << recording << "'" << std::endl;
+            return 1;
+        }
+    }
+    else
+    {
+        std::streambuf *out = mute();
+        {
+            office encoder{1};
+            for (size_t i = 0; i < desk_counts.size(); i++)
+            {
+                workloads.push_back(synthetic_frames(encoder, desk_counts[i], n_frames));
+            }
+        }
+        unmute(out);
+    }
+
+    printf("%-8s %-8s %14s %10s %10s %12s %12s\n", "path", "desks", "frames/s", "p50 ns", "p99 ns", "allocs/frame", "frames/read");
+    for (size_t i = 0; i < desk_counts.size(); i++)
+    {
+        result r = run_direct(desk_counts[i], workloads[i]);
+        printf("%-8s %-8d %14.0f %10.0f %10.0f %12.3f %12s\n", "direct", desk_counts[i], r.frames_per_second, r.p50_ns, r.p99_ns, r.allocations_per_frame, "-");
+
+        r = run_batch(desk_counts[i], workloads[i]);
+        printf("%-8s %-8d %14.0f %10s %10s %12.3f %12.1f\n", "batch", desk_counts[i], r.frames_per_second, "-", "-", r.allocations_per_frame, r.frames_per_read);
+
+        if (through_pty)
+        {
+            r = run_pty(desk_counts[i], workloads[i], rate);
+            printf("%-8s %-8d %14.0f %10s %10s %12.3f %12.1f\n", "pty", desk_counts[i], r.frames_per_second, "-", "-", r.allocations_per_frame, r.frames_per_read);
+        }
+    }
+
+    return 0;
+}
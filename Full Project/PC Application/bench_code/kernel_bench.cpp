@@ -0,0 +1,117 @@
+/*
+ * Micro-benchmark of the vector kernels (server_code/simd_kernels.hpp)
+ *
+ * Statistics of a last-minute window (6000 samples, as 'g S') and reductions of a metric of every desk
+ * (64 and 255 desks, as 'g A'), with and without the vector instructions. The results of both must agree.
+ *
+ * e.g. ./kernel_bench_exe -n 20000
+ */
+#include <iostream>
+#include <vector>
+#include <chrono>
+#include <random>
+#include <cmath>
+#include <cstdlib>
+#include <unistd.h>
+
+#include "simd_kernels.hpp"
+#include "database.hpp"
+
+#define DEFAULT_REPETITIONS 20000
+
+static series_stats stats_scalar(const float *values, size_t n)
+{
+    range_sums sums;
+    accumulate_range_scalar(values, n, sums);
+
+    series_stats stats;
+    stats.count = sums.count;
+    stats.min = sums.min;
+    stats.max = sums.max;
+    stats.mean = sums.sum / sums.count;
+    stats.stddev = std::sqrt(accumulate_squared_deviations_scalar(values, n, (float)stats.mean) / sums.count);
+    return stats;
+}
+
+template <class F>
+static double ns_per_call(size_t repetitions, F call)
+{
+    auto begin = std::chrono::steady_clock::now();
+    double sink = 0.0;
+    for (size_t i = 0; i < repetitions; i++)
+    {
+        sink += call();
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    volatile double keep = sink; // the loop can not be optimized away
+    (void)keep;
+    return std::chrono::duration<double, std::nano>(end - begin).count() / repetitions;
+}
+
+static bool close_to(double a, double b)
+{
+    return std::abs(a - b) <= 1e-4 * std::max(1.0, std::abs(b));
+}
+
+int main(int argc, char *argv[])
+{
+    size_t repetitions = DEFAULT_REPETITIONS;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            repetitions = std::strtoul(optarg, nullptr, 10);
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-n repetitions]" << std::endl;
+            return 1;
+        }
+    }
+
+    std::mt19937 generator(18);
+    std::normal_distribution<float> lux(60.0f, 15.0f);
+    std::vector<float> window(N_POINTS_MINUTE);
+    for (size_t i = 0; i < window.size(); i++)
+    {
+        window[i] = lux(generator);
+    }
+
+    // as a ring: two segments
+    size_t split = window.size() / 3;
+    series_stats vectorized = stats_of(&window[split], window.size() - split, &window[0], split);
+    series_stats reference = stats_scalar(window.data(), window.size());
+    bool agree = vectorized.min == reference.min && vectorized.max == reference.max &&
+                 close_to(vectorized.mean, reference.mean) && close_to(vectorized.stddev, reference.stddev);
+
+    printf("%-22s %12s %12s %10s\n", "kernel", "scalar ns", "vector ns", "speedup");
+
+    double scalar_ns = ns_per_call(repetitions, [&window]() { return stats_scalar(window.data(), window.size()).stddev; });
+    double vector_ns = ns_per_call(repetitions, [&window, split]() { return stats_of(&window[split], window.size() - split, &window[0], split).stddev; });
+    printf("%-22s %12.0f %12.0f %9.1fx\n", "stats 6000 samples", scalar_ns, vector_ns, scalar_ns / vector_ns);
+
+    int desk_counts[] = {64, 255};
+    for (int desks : desk_counts)
+    {
+        std::vector<float> column(window.begin(), window.begin() + desks);
+
+        range_sums a, b;
+        accumulate_range_scalar(column.data(), column.size(), a);
+        accumulate_range(column.data(), column.size(), b);
+        agree = agree && a.min == b.min && a.max == b.max && close_to(a.sum, b.sum);
+
+        scalar_ns = ns_per_call(repetitions * 10, [&column]() { range_sums sums; accumulate_range_scalar(column.data(), column.size(), sums); return sums.sum; });
+        vector_ns = ns_per_call(repetitions * 10, [&column]() { range_sums sums; accumulate_range(column.data(), column.size(), sums); return sums.sum; });
+        printf("%-15s %3d desks %9.0f %12.0f %9.1fx\n", "reduce", desks, scalar_ns, vector_ns, scalar_ns / vector_ns);
+    }
+
+    if (!agree)
+    {
+        std::cout << "The vector kernels do not agree with the scalar ones" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,254 @@
+/*
+ * Scalability benchmark of the TCP server
+ *
+ * Runs an office and a tcp_server in process with 1 to N io threads, and K clients that send 'g' queries
+ * (answered from the office, without the hub) one at a time, waiting for each answer.
+ * With -d D the clients speak the framed protocol and send D tagged queries in one write, then wait for the D
+ * answers and check their tags.
+ * Reports requests/s and the p50/p99 round trip (of one query, or of D) for each number of io threads.
+ *
+ * e.g. ./tcp_bench_exe -t 8 -c 16 -s 2
+ *      ./tcp_bench_exe -t 8 -c 16 -s 2 -d 200
+ */
+#include <iostream>
+#include <vector>
+#include <string>
+#include <chrono>
+#include <thread>
+#include <atomic>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <boost/asio.hpp>
+
+#include "database.hpp"
+#include "async_server.hpp"
+
+#define BENCH_PORT 18790
+#define BENCH_DESKS 3
+#define DEFAULT_MAX_THREADS 4
+#define DEFAULT_CLIENTS 8
+#define DEFAULT_SECONDS 2
+
+using boost::asio::ip::tcp;
+
+struct result
+{
+    double requests_per_second = 0.0;
+    double p50_us = 0.0;
+    double p99_us = 0.0;
+    size_t mismatched = 0; // framed answers with an unexpected tag
+};
+
+// the server prints every command through std::cout: it is muted while measuring
+static std::streambuf *mute()
+{
+    return std::cout.rdbuf(nullptr);
+}
+
+static void unmute(std::streambuf *buf)
+{
+    std::cout.rdbuf(buf);
+    std::cout.clear();
+}
+
+/*
+ * One client: sends the queries in turn until stop, and keeps the round trip of each one.
+ * With <depth> > 0, sends <depth> framed queries at once and keeps the round trip of all of them.
+ */
+static void run_client(unsigned short port, int depth, const std::atomic<bool> *stop, std::vector<uint32_t> *latencies,
+                       size_t *requests, size_t *mismatched)
+{
+    const char *queries[] = {"0ge", "2gp", "1gl", "0gf", "3gd"};
+
+    boost::asio::io_context io;
+    tcp::socket socket{io};
+    boost::system::error_code ec;
+    socket.connect(tcp::endpoint(boost::asio::ip::address_v4::loopback(), port), ec);
+    if (ec)
+    {
+        return;
+    }
+    socket.set_option(tcp::no_delay(true));
+
+    boost::asio::streambuf answer;
+    if (depth > 0)
+    {
+        std::string batch;
+        uint64_t tag = 0;
+        while (!stop->load(std::memory_order_relaxed))
+        {
+            batch.clear();
+            for (int k = 0; k < depth; k++)
+            {
+                batch += '#' + std::to_string(tag + k) + ' ' + queries[k % (sizeof(queries) / sizeof(queries[0]))] + '\n';
+            }
+
+            auto t0 = std::chrono::steady_clock::now();
+            boost::asio::write(socket, boost::asio::buffer(batch), ec);
+            for (int k = 0; k < depth && !ec; k++, tag++)
+            {
+                size_t n = boost::asio::read_until(socket, answer, '\n', ec);
+                if (ec)
+                {
+                    break;
+                }
+                const char *line = boost::asio::buffer_cast<const char *>(answer.data());
+                if (line[0] != '#' || std::strtoull(line + 1, nullptr, 10) != tag)
+                {
+                    (*mismatched)++;
+                }
+                answer.consume(n);
+            }
+            if (ec)
+            {
+                break;
+            }
+            auto t1 = std::chrono::steady_clock::now();
+
+            latencies->push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+            *requests += depth;
+        }
+        return;
+    }
+
+    for (size_t i = 0; !stop->load(std::memory_order_relaxed); i++)
+    {
+        const char *query = queries[i % (sizeof(queries) / sizeof(queries[0]))];
+
+        auto t0 = std::chrono::steady_clock::now();
+        boost::asio::write(socket, boost::asio::buffer(query, std::strlen(query)), ec);
+        if (ec)
+        {
+            break;
+        }
+        size_t n = boost::asio::read_until(socket, answer, '\n', ec);
+        if (ec)
+        {
+            break;
+        }
+        answer.consume(n);
+        auto t1 = std::chrono::steady_clock::now();
+
+        latencies->push_back((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(t1 - t0).count());
+        (*requests)++;
+    }
+}
+
+static result run(int n_threads, int n_clients, int seconds, unsigned short port, int depth)
+{
+    result r;
+    std::vector<std::vector<uint32_t>> latencies(n_clients);
+    std::vector<size_t> requests(n_clients, 0);
+    std::vector<size_t> mismatched(n_clients, 0);
+
+    std::streambuf *out = mute();
+    {
+        boost::asio::io_context io;
+        office the_office{BENCH_DESKS};
+        tcp_server the_server{&io, port, &the_office, nullptr}; // 'g' queries never reach the hub
+
+        std::vector<std::thread> threads;
+        for (int i = 0; i < n_threads; i++)
+        {
+            threads.push_back(std::thread{[&io]() { io.run(); }});
+        }
+
+        std::atomic<bool> stop{false};
+        std::vector<std::thread> clients;
+        for (int i = 0; i < n_clients; i++)
+        {
+            clients.push_back(std::thread{run_client, port, depth, &stop, &latencies[i], &requests[i], &mismatched[i]});
+        }
+
+        auto begin = std::chrono::steady_clock::now();
+        std::this_thread::sleep_for(std::chrono::seconds(seconds));
+        stop = true;
+        for (size_t i = 0; i < clients.size(); i++)
+        {
+            clients[i].join();
+        }
+        auto end = std::chrono::steady_clock::now();
+
+        io.stop();
+        for (size_t i = 0; i < threads.size(); i++)
+        {
+            threads[i].join();
+        }
+
+        std::vector<uint32_t> all;
+        size_t n_requests = 0;
+        for (size_t i = 0; i < latencies.size(); i++)
+        {
+            all.insert(all.end(), latencies[i].begin(), latencies[i].end());
+            n_requests += requests[i];
+            r.mismatched += mismatched[i];
+        }
+        if (!all.empty())
+        {
+            std::sort(all.begin(), all.end());
+            r.requests_per_second = n_requests / std::chrono::duration<double>(end - begin).count();
+            r.p50_us = all[all.size() / 2] / 1000.0;
+            r.p99_us = all[all.size() * 99 / 100] / 1000.0;
+        }
+    }
+    unmute(out);
+    return r;
+}
+
+int main(int argc, char *argv[])
+{
+    int max_threads = DEFAULT_MAX_THREADS;
+    int n_clients = DEFAULT_CLIENTS;
+    int seconds = DEFAULT_SECONDS;
+    unsigned short port = BENCH_PORT;
+    int depth = 0;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "t:c:s:p:d:")) != -1)
+    {
+        switch (opt)
+        {
+        case 't':
+            max_threads = std::max(1, std::atoi(optarg));
+            break;
+        case 'c':
+            n_clients = std::max(1, std::atoi(optarg));
+            break;
+        case 's':
+            seconds = std::max(1, std::atoi(optarg));
+            break;
+        case 'p':
+            port = (unsigned short)std::atoi(optarg);
+            break;
+        case 'd':
+            depth = std::max(0, std::atoi(optarg));
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-t max io threads] [-c clients] [-s seconds per run] [-p port] [-d queries per write, framed]" << std::endl;
+            return 1;
+        }
+    }
+
+    bool matched = true;
+    printf("%-8s %-8s %-6s %14s %10s %10s\n", "threads", "clients", "depth", "requests/s", "p50 us", "p99 us");
+    for (int n_threads = 1; n_threads <= max_threads; n_threads *= 2)
+    {
+        // every run listens on its own port, the previous one may still be in TIME_WAIT
+        result r = run(n_threads, n_clients, seconds, port + n_threads, depth);
+        printf("%-8d %-8d %-6d %14.0f %10.1f %10.1f\n", n_threads, n_clients, depth, r.requests_per_second, r.p50_us, r.p99_us);
+        if (r.mismatched)
+        {
+            printf("%zu answers with an unexpected tag\n", r.mismatched);
+            matched = false;
+        }
+
+        if (n_threads < max_threads && n_threads * 2 > max_threads)
+        {
+            n_threads = max_threads / 2; // the last run always uses max threads
+        }
+    }
+
+    return matched ? 0 : 1;
+}
@@ -4,9 +4,12 @@
 #include <unistd.h>
 #include <fstream>
 
+#include "../server_code/stream_protocol.hpp"
+
 #define BUFFER_SIZE 1024
 #define PORT 18700
 #define MAX_ARDUINOS 255
+#define SAMPLE_TIME_MILIS 10
 #define COMS_MSG "Command not found. Type 'Comds' to see a list of available commands! \n\
                         The number of arduinos can not be more than: " \
                      << MAX_ARDUINOS << std::endl
@@ -17,7 +20,7 @@ using namespace boost::asio;
 
 boost::asio::streambuf stm_buff{BUFFER_SIZE};
 boost::array<char, BUFFER_SIZE> tcp_message{};
-boost::array<char, BUFFER_SIZE> udp_message{};
+boost::array<char, STREAM_DATAGRAM_BYTES> udp_message{};
 
 // global variables to control whether the client runs or not
 bool stop_server = false;
@@ -27,6 +30,22 @@ bool udp_connection = false;
 // file
 std::ofstream file;
 
+// sequence number expected in the next binary datagram
+uint32_t stream_sequence = 0;
+
+/*
+ * Reassembles a batched dump ('B' and 'H' commands) from its datagrams, which may arrive out of order
+ */
+struct batch_transfer
+{
+    bool active = false;
+    uint32_t id = 0;
+    batch_header header{};
+    std::vector<float> values;
+    std::vector<bool> received; // per datagram
+    size_t n_received = 0;
+} transfer;
+
 void print_commands()
 {
     std::cout << "---------------------------------------------TCP Commands---------------------------------------------" << std::endl;
@@ -52,22 +71,138 @@ void print_commands()
     std::cout << "| g v T       - get total visibility error since last system restart                                 |" << std::endl;
     std::cout << "| g f <i>     - get accumulated flicker error at desk <i> since last system restart                  |" << std::endl;
     std::cout << "| g f T       - get total flicker error since last system restart                                    |" << std::endl;
+    std::cout << "| g e/p/v/f <i> <s> - the same at desk <i> (or T) in the last <s> seconds, e.g. g f 2 300s           |" << std::endl;
+    std::cout << "| g S <x> <i> - get min, max, mean and std deviation of the last minute of <x> at desk <i>           |" << std::endl;
+    std::cout << "| g A <x>     - get <x> (e, p, v, f, c, d, l, O, U or o) of all desks at once, with sum, min and max |" << std::endl;
+    std::cout << "| g T         - get every value of every desk and the totals at once, as a CSV table                 |" << std::endl;
+    std::cout << "| w <x> <i> <t> - push <x> of desk <i> (or T) when it moves more than <t>, <x> '*' all of them       |" << std::endl;
+    std::cout << "| W <x> <i>   - stop pushing <x> of desk <i> (or T)                                                  |" << std::endl;
     std::cout << "| r           - restart system                                                                       |" << std::endl;
     std::cout << "|--------------------------------------------UDP Commands--------------------------------------------|" << std::endl;
     std::cout << "| b <x> <i>   - get last minute buffer of variable <x> of desk <i>; NOTE: <x> can be 'l' or 'd'      |" << std::endl;
     std::cout << "| s <x> <i>   - stop stream of real-time variable <x> of desk <i>; NOTE: <x> can be 'l' or 'd'       |" << std::endl;
+    std::cout << "| S <x> <i>   - start/stop binary stream of variable <x> of desk <i>, several can run at once        |" << std::endl;
+    std::cout << "| B <x> <i>   - get last minute buffer of variable <x> of desk <i> in ~20 datagrams                  |" << std::endl;
+    std::cout << "| H <x> <i> <s> - get the last <s> seconds of variable <x> of desk <i> in batched datagrams          |" << std::endl;
+    std::cout << "| h <x> <i> <s> - same as H: a history is always sent in batches; NOTE: <x> can be 'l' or 'd'        |" << std::endl;
     std::cout << "| file        - at the end of a command to open and write values from UDP streams                    |" << std::endl;
     std::cout << "------------------------------------------------------------------------------------------------------" << std::endl;
 }
 
+/*
+ * Stores one datagram of a batched dump, and prints the dump (or writes it in the file) once it is complete
+ */
+void decode_batch(const char *data, std::size_t size, uint32_t id)
+{
+    batch_header header;
+    if (!read_batch_header(data, size, &header))
+    {
+        std::cout << "[UDP] server: invalid batch datagram" << std::endl;
+        return;
+    }
+
+    if (!transfer.active || transfer.id != id) // a new dump
+    {
+        if (transfer.active)
+        {
+            std::cout << "[UDP] incomplete dump: " << transfer.n_received << " of " << transfer.header.parts << " datagrams" << std::endl;
+        }
+        transfer.active = true;
+        transfer.id = id;
+        transfer.header = header;
+        transfer.values.assign((size_t)header.parts * STREAM_BATCH_VALUES, 0.0f);
+        transfer.received.assign(header.parts, false);
+        transfer.n_received = 0;
+    }
+
+    if (header.parts != transfer.header.parts || transfer.received[header.part] || header.offset + header.values > transfer.values.size())
+    {
+        return;
+    } // duplicated or inconsistent
+
+    for (uint16_t i = 0; i < header.values; i++)
+    {
+        transfer.values[header.offset + i] = read_batch_value(data, i);
+    }
+    transfer.received[header.part] = true;
+    transfer.n_received++;
+
+    if (header.part == header.parts - 1)
+    {
+        transfer.values.resize(header.offset + header.values); // the last datagram tells the size of the dump
+    }
+
+    if (transfer.n_received == transfer.header.parts) // complete
+    {
+        transfer.active = false;
+        std::cout << "[UDP] server: " << transfer.header.order << '\t' << transfer.header.variable << '\t' << (int)transfer.header.desk
+                  << "\t" << transfer.values.size() << " values in " << transfer.header.parts << " datagrams" << std::endl;
+
+        if (file.is_open())
+        {
+            char line[32];
+            for (size_t i = 0; i < transfer.values.size(); i++)
+            {
+                snprintf(line, sizeof(line), "%.2f\n", transfer.values[i]);
+                file << line;
+            }
+        }
+    }
+}
+
+/*
+ * Prints the samples of a binary datagram as the text stream does: s <x> <i> <value> <time>, or hands a dump datagram to decode_batch
+ */
+void decode_stream(const char *data, std::size_t size)
+{
+    char kind;
+    uint8_t count;
+    uint32_t sequence;
+    bool valid = read_stream_header(data, size, &kind, &count, &sequence);
+    if (valid && kind == STREAM_KIND_BATCH)
+    {
+        decode_batch(data, size, sequence);
+        return;
+    }
+    if (!valid || kind != STREAM_KIND_SAMPLES || size < (std::size_t)(STREAM_HEADER_BYTES + count * STREAM_SAMPLE_BYTES))
+    {
+        std::cout << "[UDP] server: invalid binary datagram" << std::endl;
+        return;
+    }
+
+    if (sequence > stream_sequence)
+    {
+        std::cout << "[UDP] lost " << sequence - stream_sequence << " datagram" << ((sequence - stream_sequence != 1) ? "s" : "") << std::endl;
+    }
+    stream_sequence = sequence + 1;
+
+    char line[64];
+    for (uint8_t i = 0; i < count; i++)
+    {
+        stream_sample sample = read_stream_sample(data, i);
+        snprintf(line, sizeof(line), "%.2f\t%.2f", sample.value, sample.ticks * SAMPLE_TIME_MILIS / 1000.0);
+
+        std::cout << "[UDP] server: S\t" << sample.variable << '\t' << (int)sample.desk << '\t' << line << std::endl;
+        if (file.is_open())
+        {
+            file << line << "\n";
+        }
+    }
+}
+
 void udp_start_read_server(ip::udp::socket *client)
 {
-    client->async_receive(buffer(udp_message, BUFFER_SIZE),
+    client->async_receive(buffer(udp_message),
                           [=](const boost::system::error_code &err, std::size_t bytes_transferred) {
-                              if (!err && bytes_transferred)
+                              if (!err && bytes_transferred && (uint8_t)udp_message[0] == STREAM_MAGIC) // binary stream
+                              {
+                                  decode_stream(udp_message.data(), bytes_transferred);
+                                  udp_start_read_server(client);
+                              }
+                              else if (!err && bytes_transferred)
                               {
                                   std::string command = std::string(udp_message.begin(), udp_message.begin() + bytes_transferred);
-                                  if (command[0] != 'b')
+                                  if (command[0] != 'b' && command[0] != 'h')
                                       std::cout << "[UDP] server: " << command << std::endl;
                                   if (file.is_open())
                                   {
@@ -128,8 +263,8 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                              char order = '.';
                              char type = '.';
                              unsigned int address = 0;
-                             char trash[]{};
-                             char input[]{};
+                             char trash[BUFFER_SIZE]{};
+                             char input[BUFFER_SIZE]{};
                              const char *command{};
                              std::string str_command;
                              int valid_command = 1;
@@ -143,7 +278,7 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
 
                              // find the word 'file'
                              std::size_t file_itr = str_input.find("file");
-                             if (file_itr != std::string::npos && (str_input[0] == 'b' || str_input[0] == 's')) // writes in file
+                             if (file_itr != std::string::npos && strchr("bsShBH", str_input[0])) // writes in file
                              {
                                  if (file_itr > 0)
                                  {
@@ -201,12 +336,21 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                              {
                              case 'b': // get last minute buffer of variable <x> of desk <i>
                              case 's': // start/stop stream of real-time variable <x> of desk <i>
+                             case 'S': // start/stop binary stream of real-time variable <x> of desk <i>
+                             case 'h': // get the last <s> seconds of variable <x> of desk <i>, sent in batches like 'H'
+                             case 'B': // get last minute buffer of variable <x> of desk <i> in batches
+                             case 'H': // get the last <s> seconds of variable <x> of desk <i> in batches
                              {
                                  valid_command = 0; // ignores
-                                 sscanf(trash, "%c %u %[^\n]", &type, &address, trash);
-                                 if ((type == 'l' || type == 'd') && udp_connection)
+                                 float seconds = 0.0;
+                                 sscanf(trash, "%c %u %f", &type, &address, &seconds);
+                                 if ((type == 'l' || type == 'd') && udp_connection && ((order != 'h' && order != 'H') || seconds > 0))
                                  {
                                      str_command = std::string(1, order) + std::string(1, type) + std::to_string(address);
+                                     if (order == 'h' || order == 'H')
+                                     {
+                                         str_command += ' ' + std::to_string(seconds);
+                                     }
                                      command = str_command.c_str();
 
                                      udp_client->async_send(buffer(command, strlen(command)),
@@ -223,6 +367,7 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                              // commands for TCP server
                              case 'g': // get commands
                              {
+                                 float window = 0.0; // seconds of the windowed metrics, 0 since the last restart
                                  sscanf(trash, "%c %u %[^\n]", &type, &address, trash);
                                  if (address > MAX_ARDUINOS)
                                  {
@@ -237,7 +382,9 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                                  case 'p': // get instantaneous power consumption in the system <T> or at desk <i>
                                  case 'v': // get visibility error in the system <T> or at desk <i> since the last restart
                                  {
-                                     if (trash[strlen(trash) - 1] == 'T' && trash[0] == type && ((strlen(trash) == 2) || (trash[1] == ' ' && strlen(trash) == 3)))
+                                     char target[BUFFER_SIZE]{};
+                                     sscanf(str_input.c_str(), "%*c %*c %s %f", target, &window);
+                                     if (strcmp(target, "T") == 0)
                                      {
                                          address = 0;
                                      }
@@ -254,6 +401,24 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                                  case 'x': // get current external illuminace at desk <i>
                                  {
                                      str_command = std::to_string(address) + std::string(1, order) + std::string(1, type);
+                                     if (window > 0)
+                                     {
+                                         str_command += ' ' + std::to_string(window);
+                                     }
+                                     break;
+                                 }
+                                 case 'T': // get every value of every desk and the totals at once
+                                 {
+                                     str_command = "0gT";
+                                     break;
+                                 }
+                                 case 'S': // get statistics of the last minute of variable <x> at desk <i>
+                                 case 'A': // get metric <x> of all desks at once
+                                 {
+                                     char variable = 0;
+                                     address = 0;
+                                     sscanf(str_input.c_str(), "%*c %*c %c %u", &variable, &address);
+                                     str_command = std::to_string(address) + std::string(1, order) + std::string(1, type) + std::string(1, variable);
                                      break;
                                  }
                                  default:
@@ -284,6 +449,20 @@ void start_read_input(boost::asio::posix::stream_descriptor *stm_desc, ip::tcp::
                                  }
                                  break;
                              }
+                             case 'w': // push value <x> of desk <i> whenever it moves more than <threshold>
+                             case 'W': // stop pushing value <x> of desk <i>
+                             {
+                                 char target[BUFFER_SIZE]{};
+                                 float threshold = 0.0;
+                                 sscanf(trash, "%c %s %f", &type, target, &threshold);
+                                 address = strcmp(target, "T") == 0 ? 0 : (unsigned int)std::atoi(target);
+                                 str_command = std::to_string(address) + std::string(1, order) + std::string(1, type);
+                                 if (order == 'w')
+                                 {
+                                     str_command += ' ' + std::to_string(threshold);
+                                 }
+                                 break;
+                             }
                              case 'r': // restart system
                              {
                                  if (strlen(input) == 2 && input[1] == '\n')
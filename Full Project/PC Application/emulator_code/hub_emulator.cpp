@@ -0,0 +1,420 @@
+/*
+ * Hub emulator
+ *
+ * Opens a pseudo-terminal and speaks the serial protocol of the Arduino hub (hub() and sendHubInitials() in controller.ino),
+ * so the whole server can be run and load-tested without Arduinos:
+ *
+ *   ./hub_emulator_exe -n 16 -r 1000 -l /tmp/ttyHUB
+ *   ./server_exe -d /tmp/ttyHUB
+ *
+ * NOTE: as in controller.ino, the server writes the desk address of set/get commands as one ASCII digit (address + '0').
+ */
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <poll.h>
+#include <termios.h>
+#include <unistd.h>
+
+#include "../server_code/fixed_point.hpp"
+
+#define DEFAULT_DESKS 3
+#define DEFAULT_RATE 100     // samples per second of each desk
+#define MAX_RATE 10000       // samples per second of each desk
+#define MAX_CATCH_UP_TICKS 8 // ticks sent at once when the emulator falls behind
+#define RESTART_DELAY_MS 1000 // the Arduinos take ~5 s to boot after a restart
+#define COMMAND_SIZE 4        // bytes after '+'
+#define LISTEN_POLL_MS 100    // how often the listener looks at stop_emulator while the server is quiet
+
+/*
+ * State of each emulated desk
+ */
+struct desk
+{
+    bool occupied = false;
+    float lower_bound_occupied = 50.0;
+    float lower_bound_unoccupied = 20.0;
+    float cost = 1.0;
+    float external = 10.0; // external illuminance
+};
+
+std::vector<desk> desks;
+std::mutex desks_mutex;
+
+int master = -1;
+std::mutex write_mutex;
+
+std::atomic<bool> streaming{false};
+std::atomic<bool> stop_emulator{false};
+std::atomic<uint64_t> frames_sent{0};
+auto boot_time = std::chrono::steady_clock::now();
+
+/*
+ * Same format as float_2_bytes of controller.ino: 12 bits of integer part and 4 bits of decimal part, the most significative byte first
+ */
+void float_2_bytes(float fnum, char *out)
+{
+    uint16_t output = fixed_12_4_encode(fnum);
+    out[0] = (char)(uint8_t)(output >> 8);
+    out[1] = (char)(uint8_t)output;
+}
+
+float bytes_2_float(const char *in)
+{
+    return fixed_12_4_decode(fixed_12_4_from_bytes(in[0], in[1]));
+}
+
+void write_frames(const std::string &frames, uint64_t n_frames)
+{
+    std::lock_guard<std::mutex> lock(write_mutex);
+    size_t sent = 0;
+    while (sent < frames.size())
+    {
+        ssize_t n = write(master, frames.data() + sent, frames.size() - sent);
+        if (n <= 0)
+        {
+            return;
+        }
+        sent += n;
+    }
+    frames_sent += n_frames;
+}
+
+void append_frame(std::string &frames, char type, uint8_t address, float value)
+{
+    char bytes[2];
+    float_2_bytes(value, bytes);
+    frames += '+';
+    frames += type;
+    frames += (char)address;
+    frames.append(bytes, 2);
+}
+
+/*
+ * "+A<number of desks>:)"
+ */
+void greeting()
+{
+    std::string frame = "+A";
+    frame += (char)(uint8_t)desks.size();
+    frame += ":)";
+    write_frames(frame, 1);
+}
+
+/*
+ * Elapsed time, state, bounds and cost of every desk - sendHubInitials() of controller.ino
+ */
+void send_hub_initials()
+{
+    std::string frames;
+    uint64_t n_frames = 0;
+
+    double time_ = std::chrono::duration<double>(std::chrono::steady_clock::now() - boot_time).count();
+    unsigned long high = (unsigned long)std::round(time_) & 0xFF000;
+    frames += "+t";
+    frames += (char)(uint8_t)(high >> 12);
+    char bytes[2];
+    float_2_bytes(time_ - high, bytes);
+    frames.append(bytes, 2);
+    n_frames++;
+
+    std::lock_guard<std::mutex> lock(desks_mutex);
+    for (size_t a = 0; a < desks.size(); a++, n_frames++)
+        append_frame(frames, 'o', a + 1, desks[a].occupied);
+    for (size_t a = 0; a < desks.size(); a++, n_frames++)
+        append_frame(frames, 'O', a + 1, desks[a].lower_bound_occupied);
+    for (size_t a = 0; a < desks.size(); a++, n_frames++)
+        append_frame(frames, 'U', a + 1, desks[a].lower_bound_unoccupied);
+    for (size_t a = 0; a < desks.size(); a++, n_frames++)
+        append_frame(frames, 'c', a + 1, desks[a].cost);
+
+    write_frames(frames, n_frames);
+}
+
+/*
+ * Illuminance that the desk would measure at the sample <tick>
+ */
+float luminance(const desk &d, uint64_t tick, int address)
+{
+    float reference = d.occupied ? d.lower_bound_occupied : d.lower_bound_unoccupied;
+    return reference + 0.5f * std::sin(0.05f * tick + address);
+}
+
+float duty_cicle(const desk &d, float lux)
+{
+    float duty = 100.0f * (lux - d.external) / 300.0f;
+    return duty < 0 ? 0 : duty > 100 ? 100 : duty;
+}
+
+/*
+ * Sends "+s<address><luminance><duty cicle>" of every desk at <rate> samples per second
+ */
+void stream(int rate)
+{
+    auto period = std::chrono::nanoseconds(1000000000LL / rate);
+    auto next = std::chrono::steady_clock::now();
+    uint64_t tick = 0;
+    std::string frames;
+
+    while (!stop_emulator)
+    {
+        std::this_thread::sleep_until(next);
+        if (!streaming)
+        {
+            next = std::chrono::steady_clock::now() + period;
+            continue;
+        }
+
+        // sends every tick that is due, at most MAX_CATCH_UP_TICKS at once
+        frames.clear();
+        uint64_t n_frames = 0;
+        auto now = std::chrono::steady_clock::now();
+        {
+            std::lock_guard<std::mutex> lock(desks_mutex);
+            for (int t = 0; t < MAX_CATCH_UP_TICKS && next <= now; t++, tick++, next += period)
+            {
+                for (size_t a = 0; a < desks.size(); a++, n_frames++)
+                {
+                    float lux = luminance(desks[a], tick, a + 1);
+                    char bytes[4];
+                    float_2_bytes(lux, bytes);
+                    float_2_bytes(duty_cicle(desks[a], lux), bytes + 2);
+                    frames += "+s";
+                    frames += (char)(uint8_t)(a + 1);
+                    frames.append(bytes, 4);
+                }
+            }
+        }
+        if (next <= now)
+        {
+            next = now + period;
+        } // too far behind: drops the missing ticks
+
+        write_frames(frames, n_frames);
+    }
+}
+
+/*
+ * Answers a command of the server - hub() of controller.ino
+ */
+void handle_command(const char *command)
+{
+    if (!memcmp(command, "RPiG", COMMAND_SIZE))
+    {
+        greeting();
+        return;
+    }
+    if (!memcmp(command, "RPiS", COMMAND_SIZE))
+    {
+        send_hub_initials();
+        streaming = true;
+        return;
+    }
+    if (!memcmp(command, "RPiE", COMMAND_SIZE))
+    {
+        streaming = false;
+        return;
+    }
+    if (!memcmp(command, "rrrr", COMMAND_SIZE)) // restart: the desks boot again with the default values
+    {
+        streaming = false;
+        {
+            std::lock_guard<std::mutex> lock(desks_mutex);
+            desks.assign(desks.size(), desk());
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(RESTART_DELAY_MS));
+        boot_time = std::chrono::steady_clock::now();
+        greeting();
+        send_hub_initials();
+        streaming = true;
+        return;
+    }
+
+    char type = command[0];
+    int address = command[1] - '0';
+    float value = bytes_2_float(&command[2]);
+    std::string reply;
+
+    {
+        std::lock_guard<std::mutex> lock(desks_mutex);
+        if (address < 1 || address > (int)desks.size())
+        {
+            return;
+        }
+        desk &d = desks[address - 1];
+
+        switch (type)
+        {
+        case 'o':
+            d.occupied = value != 0;
+            break;
+        case 'O':
+            d.lower_bound_occupied = value;
+            break;
+        case 'U':
+            d.lower_bound_unoccupied = value;
+            break;
+        case 'c':
+            d.cost = value;
+            break;
+        case 'x': // external illuminance
+            append_frame(reply, 'x', address, d.external);
+            break;
+        case 'r': // illuminance control reference
+            append_frame(reply, 'r', address, d.occupied ? d.lower_bound_occupied : d.lower_bound_unoccupied);
+            break;
+        default:
+            return;
+        }
+    }
+
+    if (reply.empty()) // set commands echo the command as the acknowledge
+    {
+        reply = '+';
+        reply += type;
+        reply += (char)(uint8_t)address;
+        reply.append(&command[2], 2);
+    }
+    write_frames(reply, 1);
+}
+
+/*
+ * Reads "+<4 bytes>" commands from the server
+ */
+void listen()
+{
+    char command[COMMAND_SIZE];
+    int received = -1; // -1: waiting for '+'
+    char byte;
+
+    while (!stop_emulator)
+    {
+        // a blocking read would never see stop_emulator, the signal handler does not interrupt it
+        struct pollfd readable = {master, POLLIN, 0};
+        if (poll(&readable, 1, LISTEN_POLL_MS) <= 0)
+        {
+            continue;
+        }
+
+        ssize_t n = read(master, &byte, 1);
+        if (n <= 0)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+            continue;
+        }
+
+        if (received < 0)
+        {
+            received = (byte == '+') ? 0 : -1;
+            continue;
+        }
+
+        command[received++] = byte;
+        if (received == COMMAND_SIZE)
+        {
+            handle_command(command);
+            received = -1;
+        }
+    }
+}
+
+void safety_exit(int sig)
+{
+    stop_emulator = true;
+}
+
+int main(int argc, char *argv[])
+{
+    int n_desks = DEFAULT_DESKS;
+    int rate = DEFAULT_RATE;
+    std::string link;
+
+    int opt;
+    while ((opt = getopt(argc, argv, "n:r:l:")) != -1)
+    {
+        switch (opt)
+        {
+        case 'n':
+            n_desks = std::atoi(optarg);
+            break;
+        case 'r':
+            rate = std::atoi(optarg);
+            break;
+        case 'l':
+            link = optarg;
+            break;
+        default:
+            std::cout << "usage: " << argv[0] << " [-n desks (1-255)] [-r samples per second (1-" << MAX_RATE << ")] [-l link to the pty]" << std::endl;
+            return 1;
+        }
+    }
+    if (n_desks < 1 || n_desks > 255 || rate < 1 || rate > MAX_RATE)
+    {
+        std::cout << "The number of desks must be in 1-255 and the rate in 1-" << MAX_RATE << std::endl;
+        return 1;
+    }
+    desks.resize(n_desks);
+
+    // pseudo-terminal: the server opens the slave side as if it was the Arduino
+    master = posix_openpt(O_RDWR | O_NOCTTY);
+    if (master < 0 || grantpt(master) != 0 || unlockpt(master) != 0)
+    {
+        std::cout << "Could not open a pseudo-terminal" << std::endl;
+        return 1;
+    }
+    std::string slave_name = ptsname(master);
+
+    // keeps the slave open in raw mode, so the pty survives the server closing and opening it again
+    int slave = open(slave_name.c_str(), O_RDWR | O_NOCTTY);
+    struct termios ios;
+    tcgetattr(slave, &ios);
+    cfmakeraw(&ios);
+    tcsetattr(slave, TCSANOW, &ios);
+
+    if (!link.empty())
+    {
+        unlink(link.c_str());
+        if (symlink(slave_name.c_str(), link.c_str()) != 0)
+        {
+            std::cout << "Could not create the link " << link << std::endl;
+            link.clear();
+        }
+    }
+
+    std::cout << "Hub emulator with " << n_desks << " desk" << (n_desks != 1 ? "s" : "") << " at " << rate << " samples/s on "
+              << (link.empty() ? slave_name : link + " -> " + slave_name) << std::endl;
+
+    std::signal(SIGINT, safety_exit);
+    std::signal(SIGTERM, safety_exit);
+
+    std::thread streamer{stream, rate};
+    std::thread listener{listen};
+
+    uint64_t last = 0;
+    while (!stop_emulator)
+    {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t sent = frames_sent;
+        std::cout << "frames/s: " << sent - last << "\t total: " << sent << std::endl;
+        last = sent;
+    }
+
+    streamer.join();
+    listener.join();
+    close(master);
+    close(slave);
+    if (!link.empty())
+    {
+        unlink(link.c_str());
+    }
+    return 0;
+}
@@ -129,22 +129,7 @@ bool hub()
  */
 void float_2_bytes(float fnum)
 {   
-    // the maxium admissive value is 4095.94(9)
-    fnum = fnum < pow(2,12)-0.05 ? fnum : pow(2,12)-1+0.9;  // 2^12-1 == 4095, 12 bits representation + 4bits to decimal representation(0.1 -> 0.9)
-  
-    uint16_t output = fnum < 0; // flag that represents if fnum is negative
-    uint16_t inum = fnum;  // integer part
-    fnum = fnum-inum; // floating part
-    uint8_t dnum = round(10*fnum);  // integer decimal part
-
-    // increments one when the decimal part rounds up
-    if(dnum == 10){
-        dnum = 0;
-        inum++;
-    }
-    
-    inum = inum<<4; // the integer will be represent in the first 1,5 bits
-    output = output ? 15: inum + dnum; // send 15 when fnum is negative, which should not be possible
+    uint16_t output = fixed_12_4_encode(fnum); // see fixed_point.hpp
     
     Serial.write( (byte) (output>>8) ); // wirte second byte - DEBUG: Serial.println((byte) (output>>8))
     Serial.write( (byte) output );  // write first byte - DEBUG: Serial.println((byte) output);
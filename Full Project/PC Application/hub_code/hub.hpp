@@ -3,6 +3,7 @@
 
 #include <Math.h>
 #include "Arduino.h"
+#include "fixed_point.hpp"
 #define BUFFER_SIZE 5 // number of char to read plus \0
 
 void float_2_bytes(float fnum);
@@ -1,84 +1,183 @@
 #include "async_server.hpp"
 
+#include <cmath>
+
 /* --------------------------------------------------------------------------------
    |                                  UDP                                        |
    -------------------------------------------------------------------------------- */
 
 udp_server::udp_server(boost::asio::io_service *io, unsigned short port, office *database) : t_database(database),
-                                                                                             t_socket(*io, udp::endpoint(udp::v4(), port))
+                                                                                             t_socket(*io, udp::endpoint(udp::v4(), port)),
+                                                                                             t_strand(*io),
+                                                                                             t_last_minute(new float[database->get_minute_points()])
 {
     std::cout << "UDP server is open!" << std::endl;
+    t_database->set_udp_socket(&t_socket, &t_strand);
     start_receive();
 }
 
+/*
+ * Aborts the receive, its handler lives in t_handler_memory: the io_context must run it before the server is destroyed
+ */
+void udp_server::stop()
+{
+    boost::asio::post(t_strand, [this]() {
+        boost::system::error_code ec;
+        t_socket.close(ec);
+    });
+}
+
 void udp_server::start_receive()
 {
     t_socket.async_receive_from(
-        boost::asio::buffer(t_recv_buffer), t_remote_endpoint,
-        boost::bind(
-            &udp_server::handle_receive,
-            this,
-            boost::asio::placeholders::error,
-            boost::asio::placeholders::bytes_transferred));
+        boost::asio::buffer(t_recv_buffer.data(), t_recv_buffer.size() - 1), t_remote_endpoint, // room for the terminator
+        boost::asio::bind_executor(t_strand, make_memory_handler(t_handler_memory, boost::bind(
+                                                                                       &udp_server::handle_receive,
+                                                                                       this,
+                                                                                       boost::asio::placeholders::error,
+                                                                                       boost::asio::placeholders::bytes_transferred))));
 }
 
 void udp_server::handle_receive(const boost::system::error_code &error, size_t bytes_transferred)
 {
     if (!error && bytes_transferred)
     {
-        std::string command = std::string(t_recv_buffer.begin(), t_recv_buffer.begin() + bytes_transferred);
+        char *command = t_recv_buffer.data();
+        command[bytes_transferred] = '\0';
         char order = 'u';
         char type = 'u';
         int address = 0;
+        float seconds = 0.0;
 
-        sscanf(command.c_str(), "%c %c %d", &order, &type, &address);
+        sscanf(command, "%c %c %d %f", &order, &type, &address, &seconds);
 
         std::cout << "Received: '" << order << ' ' << type << ' ' << address << "'\t"
                   << " bytes received: " << bytes_transferred << std::endl;
 
-        std::string header = std::string(1, order) + '\t' + std::string(1, type) + '\t' + std::to_string(address) + '\t';
+        char header[32];
+        size_t header_size = 0;
+        reply_writer(header, sizeof(header) - 1, &header_size).put(order).put('\t').put(type).put('\t').put_integer(address).put('\t');
+        header[header_size] = '\0';
 
         if (1 > address || address > t_database->get_num_lamps())
         {
-            std::string response = "The number of Total desks connected in the network is: " + std::to_string(t_database->get_num_lamps());
-
-            t_socket.async_send_to(boost::asio::buffer(response.c_str(), response.size()), t_remote_endpoint,
-                                   [response](const boost::system::error_code &t_ec, std::size_t len) {
-                                       std::cout << response << std::endl;
-                                   });
+            reply_buffer *reply = t_replies.acquire();
+            reply_writer(reply).put("The number of Total desks connected in the network is: ").put_integer(t_database->get_num_lamps());
+            send_reply(reply);
         }
-        else if (order == 'b') // get last minute buffer of variable <x> of desk <i>; NOTE: <x> can be 'l' or 'd'
+        else if (order == 'b' || order == 'B') // get last minute buffer of variable <x> of desk <i>, 'B' in batches; NOTE: <x> can be 'l' or 'd'
         {
-            send_last_minute(header, type, address, t_remote_endpoint);
+            send_last_minute(header, order, type, address, t_remote_endpoint);
         }
         else if (order == 's') // stop stream of real-time variable <x> of desk <i>; NOTE: <x> can be 'l' or 'd'
         {
             set_stream(type, address, t_remote_endpoint);
         }
+        else if (order == 'S') // start/stop binary stream of real-time variable <x> of desk <i>, see stream_protocol.hpp
+        {
+            set_binary_stream(type, address, t_remote_endpoint);
+        }
+        else if (order == 'h' || order == 'H') // get the history of the last <seconds> of variable <x> of desk <i>, always in batches; NOTE: <x> can be 'l' or 'd'
+        {
+            send_history(order, type, address, seconds, t_remote_endpoint);
+        }
     }
-    start_receive();
+    if (t_socket.is_open()) // closed by stop()
+    {
+        start_receive();
+    }
+}
+
+void udp_server::send_last_minute(const char *header, char order, char type, int address, udp::endpoint remote_endpoint)
+{
+    lamp *desk = &t_database->desk(address);
+    circular_array<float> &history = (type == 'd') ? desk->t_duty_cicle : desk->t_luminance;
+
+    // consistent snapshot of the ring: at most two memcpy's into the reused buffer, no allocation
+    size_t n_points = history.copy_all(t_last_minute.get());
+
+    if (order == 'B')
+    {
+        send_batch(order, type, address, t_last_minute.get(), n_points, remote_endpoint);
+    }
+    else
+    {
+        send_values(header, t_last_minute.get(), n_points, remote_endpoint);
+    }
+}
+
+/*
+ * A history may span hours of samples, so it is never sent one datagram per value: 'h' is batched like 'H'
+ */
+void udp_server::send_history(char order, char type, int address, float seconds, udp::endpoint remote_endpoint)
+{
+    t_history_values.clear();
+    size_t n_points = t_database->get_history(type, address, seconds, t_history_values);
+
+    send_batch(order, type, address, t_history_values.data(), n_points, remote_endpoint);
 }
 
-void udp_server::send_last_minute(std::string header, char type, int address, udp::endpoint remote_endpoint)
+/*
+ * Sends one datagram per value, with one decimal. Every datagram of the dump is written into one buffer, shared by
+ * the sends until the last one completes.
+ */
+void udp_server::send_values(const char *header, const float *values, size_t n_values, udp::endpoint remote_endpoint)
 {
-    std::unique_ptr<float[]> value = t_database->t_lamps_array[address - 1]->t_luminance.get_all();
+    size_t stride = std::strlen(header) + UDP_VALUE_BYTES;
+    std::shared_ptr<std::vector<char>> datagrams = std::make_shared<std::vector<char>>(n_values * stride);
+
+    for (size_t i = 0; i < n_values; i++)
+    {
+        char *datagram = &(*datagrams)[i * stride];
+        size_t size = 0;
+        reply_writer response(datagram, stride, &size);
+        response.put(header).put_number(values[i]).cut(5); // "%f" has 6 decimals
+
+        t_socket.async_send_to(boost::asio::buffer(datagram, size), remote_endpoint,
+                               [datagrams](const boost::system::error_code &t_ec, std::size_t len) {
+                                   // Nice Job :)
+                               });
+    }
+}
+
+/*
+ * Sends the values in datagrams of STREAM_BATCH_VALUES floats, see stream_protocol.hpp.
+ * Every datagram of the dump is written into one buffer, shared by the sends until the last one completes.
+ */
+void udp_server::send_batch(char order, char type, int address, const float *values, size_t n_values, udp::endpoint remote_endpoint)
+{
+    size_t parts = n_values ? (n_values + STREAM_BATCH_VALUES - 1) / STREAM_BATCH_VALUES : 1; // an empty dump is one datagram without values
+    if (parts > UINT16_MAX)
+    {
+        parts = UINT16_MAX;
+        n_values = parts * STREAM_BATCH_VALUES;
+    }
+
+    std::shared_ptr<std::vector<char>> datagrams = std::make_shared<std::vector<char>>(parts * STREAM_DATAGRAM_BYTES);
+    uint32_t transfer = t_transfers++;
 
-    for (int i = 0; i < N_POINTS_MINUTE; i++)
+    for (size_t p = 0; p < parts; p++)
     {
-        std::string response = std::to_string(value[i]);
+        size_t offset = p * STREAM_BATCH_VALUES;
+        batch_header header{order, type, (uint8_t)address, (uint16_t)p, (uint16_t)parts,
+                            (uint16_t)std::min<size_t>(STREAM_BATCH_VALUES, n_values - offset), (uint32_t)offset};
 
-        response = header + response.erase(response.size() - 5);
+        char *datagram = &(*datagrams)[p * STREAM_DATAGRAM_BYTES];
+        size_t size = write_batch_datagram(datagram, transfer, header, values + offset);
 
-        t_socket.async_send_to(boost::asio::buffer(response.c_str(), response.size()), remote_endpoint,
-                               [response](const boost::system::error_code &t_ec, std::size_t len) {
-                                   std::cout << response << std::endl;
+        t_socket.async_send_to(boost::asio::buffer(datagram, size), remote_endpoint,
+                               [datagrams](const boost::system::error_code &t_ec, std::size_t len) {
+                                   // Nice Job :)
                                });
     }
+
+    if (DEBUG)
+        std::cout << "Sent " << n_values << " values in " << parts << " datagram" << ((parts != 1) ? "s" : "") << std::endl;
 }
 
 void udp_server::set_stream(char type, int address, udp::endpoint remote_endpoint)
 {
-    int decision = t_database->set_upd_stream(type, address, &t_socket, remote_endpoint);
+    int decision = t_database->set_upd_stream(type, address, remote_endpoint);
     std::cout << "Decision = " << decision << std::endl;
     if (decision == 0)
     {
@@ -94,14 +193,32 @@ void udp_server::set_stream(char type, int address, udp::endpoint remote_endpoin
     }
 }
 
+void udp_server::set_binary_stream(char type, int address, udp::endpoint remote_endpoint)
+{
+    int decision = t_database->set_binary_stream(type, address, remote_endpoint);
+    if (decision != 0)
+    {
+        send_acknowledgement(decision == 1);
+    }
+}
+
 void udp_server::send_acknowledgement(bool ack_err)
 {
-    std::string response = (std::string("\t\t\t\t\t\t\t\t")) + (ack_err ? "ack" : "err");
+    reply_buffer *reply = t_replies.acquire();
+    reply_writer(reply).put("\t\t\t\t\t\t\t\t").put(ack_err ? "ack" : "err");
+    send_reply(reply);
+}
 
-    t_socket.async_send_to(boost::asio::buffer(response.c_str(), response.size()), t_remote_endpoint,
-                           [response](const boost::system::error_code &t_ec, std::size_t len) {
-                               std::cout << response << std::endl;
-                           });
+/*
+ * Sends an answer to the client of the last datagram, the buffer goes back to the pool when it is sent
+ */
+void udp_server::send_reply(reply_buffer *reply)
+{
+    t_socket.async_send_to(boost::asio::buffer(reply->data, reply->size), t_remote_endpoint,
+                           boost::asio::bind_executor(t_strand, make_memory_handler(t_handler_memory, [this, reply](const boost::system::error_code &t_ec, std::size_t len) {
+                                                          std::cout.write(reply->data, reply->size) << std::endl;
+                                                          t_replies.release(reply);
+                                                      })));
 }
 
 /* --------------------------------------------------------------------------------------
@@ -109,338 +226,573 @@ void udp_server::send_acknowledgement(bool ack_err)
    | https://www.boost.org/doc/libs/1_35_0/doc/html/boost_asio/tutorial/tutdaytime3.html |                                |
    -------------------------------------------------------------------------------------- */
 
-tcp_server::tcp_server(boost::asio::io_service *io, unsigned short port, office *database, communications *serial) : t_database(database),
-                                                                                                                     t_serial(serial),
-                                                                                                                     t_io(io),
-                                                                                                                     t_acceptor(*io, tcp::endpoint(tcp::v4(), port))
+static int64_t steady_seconds()
 {
-    start_accept();
+    return std::chrono::duration_cast<std::chrono::seconds>(std::chrono::steady_clock::now().time_since_epoch()).count();
+}
+
+tcp_server::tcp_server(boost::asio::io_service *io, unsigned short port, office *database, communications *serial,
+                       size_t max_connections, int idle_seconds) : t_database(database),
+                                                                   t_serial(serial),
+                                                                   t_max_connections(max_connections),
+                                                                   t_idle_seconds(idle_seconds),
+                                                                   t_io(io),
+                                                                   t_strand(*io),
+                                                                   t_acceptor(*io, tcp::endpoint(tcp::v4(), port)),
+                                                                   t_refused(*io),
+                                                                   t_sweep(*io)
+{
+    t_connections.reserve(t_max_connections);
+    t_free.reserve(t_max_connections);
+    boost::asio::post(t_strand, [this]() {
+        start_accept();
+        start_sweep();
+    });
 }
 
 tcp_server::~tcp_server()
 {
     t_acceptor.close();
+    t_sweep.cancel();
+    t_connections.clear(); // closes every client
+}
 
-    // delete all clients backwards
-    std::vector<int>::size_type sz = connections.size();
-    for (unsigned int i = 0; i < sz; i++)
+/*
+ * Stops accepting and closes every client. The aborted operations of the connections live in their handler_memory,
+ * so the io_context must run them before the server is destroyed
+ */
+void tcp_server::stop()
+{
+    boost::asio::post(t_strand, [this]() {
+        boost::system::error_code ec;
+        t_acceptor.close(ec);
+        t_refused.close(ec);
+        t_sweep.cancel();
+        for (size_t i = 0; i < t_connections.size(); i++)
+        {
+            t_connections[i]->stop();
+        }
+    });
+}
+
+/*
+ * A free connection, a new one while there are less than t_max_connections, or nullptr
+ */
+tcp_connection *tcp_server::take_connection()
+{
+    if (!t_free.empty())
+    {
+        tcp_connection *connection = t_free.back();
+        t_free.pop_back();
+        return connection;
+    }
+    if (t_connections.size() == t_max_connections)
     {
-        delete connections.at(i);
+        return nullptr;
     }
+
+    tcp_connection *connection = new tcp_connection{t_io, t_database, t_serial};
+    t_connections.push_back(std::unique_ptr<tcp_connection>(connection));
+    connection->on_released = [this, connection]() {
+        boost::asio::post(t_strand, [this, connection]() { t_free.push_back(connection); });
+    };
+    return connection;
 }
+
 /*
- * Creates a socket and initiates an asynchronous accept operation to wait for a new connection.
+ * Waits for the next client, in a free connection. When every connection is taken the client is accepted and closed
+ * right away, so it knows it was refused instead of waiting in the backlog.
  */
 void tcp_server::start_accept()
 {
-    new_connection = new tcp_connection{t_io, t_database, t_serial};
-    connections.push_back(new_connection); // save clients in the list
+    tcp_connection *connection = take_connection();
+    if (!connection)
+    {
+        t_acceptor.async_accept(t_refused, boost::asio::bind_executor(t_strand, [this](const boost::system::error_code &err) {
+                                    if (err == boost::asio::error::operation_aborted)
+                                    {
+                                        return;
+                                    }
+                                    if (!err)
+                                    {
+                                        tcp_connection *connection = take_connection(); // one may have been freed meanwhile
+                                        if (connection)
+                                        {
+                                            connection->socket() = std::move(t_refused);
+                                            connection->start();
+                                        }
+                                        else
+                                        {
+                                            std::cout << "TCP client refused, there are already " << t_max_connections << " clients" << std::endl;
+                                            t_refused.close();
+                                        }
+                                    }
+                                    start_accept();
+                                }));
+        return;
+    }
 
-    t_acceptor.async_accept(new_connection->socket(),
-                            [this](const boost::system::error_code &err) {
+    t_acceptor.async_accept(connection->socket(), boost::asio::bind_executor(t_strand, [this, connection](const boost::system::error_code &err) {
                                 if (!err)
                                 {
-                                    std::cout << "New TCP client! " << new_connection->t_client_address << std::endl;
-                                    new_connection->start_timer();   // starts timer
-                                    new_connection->start_receive(); // start receive instructions
+                                    connection->start(); // start receive instructions
                                 }
                                 else
                                 {
-                                    // delete new_connection;
+                                    t_free.push_back(connection);
+                                }
+
+                                if (err != boost::asio::error::operation_aborted)
+                                {
+                                    start_accept();
                                 }
-                                start_accept();
-                            } //end async_accept lambda arg
-    );                        //end async_accept cal
+                            }));
+}
+
+/*
+ * Closes the clients that sent nothing for t_idle_seconds, one timer for all of them
+ */
+void tcp_server::start_sweep()
+{
+    if (t_idle_seconds <= 0)
+    {
+        return;
+    }
+    t_sweep.expires_after(std::chrono::seconds(std::min(t_idle_seconds, IDLE_SWEEP_SECONDS)));
+    t_sweep.async_wait(boost::asio::bind_executor(t_strand, [this](const boost::system::error_code &err) {
+        if (err)
+        {
+            return;
+        }
+        int64_t now = steady_seconds();
+        for (size_t i = 0; i < t_connections.size(); i++)
+        {
+            t_connections[i]->close_if_idle(now, t_idle_seconds);
+        }
+        start_sweep();
+    }));
+}
+
+tcp_connection::tcp_connection(boost::asio::io_service *io, office *database, communications *serial) : t_socket(*io), t_database(database), t_serial(serial), t_strand(*io)
+{
+    // the ingest resolves the commands, the answers are sent from the strand of the connection
+    t_pending.on_completed = [this]() {
+        t_operations++;
+        boost::asio::post(t_strand, [this]() {
+            deliver_completed();
+            finish_operation();
+        });
+    };
+    // the ingest publishes the changes of the values followed, they are sent from the strand too
+    t_subscriber.on_changed = [this]() {
+        t_operations++;
+        boost::asio::post(t_strand, [this]() {
+            deliver_changes();
+            finish_operation();
+        });
+    };
+}
+
+/*
+ * Serves the client just accepted in the socket
+ */
+void tcp_connection::start()
+{
+    boost::asio::post(t_strand, [this]() {
+        boost::system::error_code ec;
+        tcp::endpoint remote = t_socket.remote_endpoint(ec);
+        t_client_address = ec ? std::string("unknown") : remote.address().to_string() + ':' + std::to_string(remote.port());
+        std::cout << "New TCP client! " << t_client_address << std::endl;
+        t_socket.set_option(tcp::no_delay(true), ec); // the answers are already batched, a small last one must not wait
+
+        t_state = connection_open;
+        t_last_active = steady_seconds();
+        t_framed = false;
+        t_partial = 0;
+        t_receive_paused = false;
+        t_changes_waiting = false;
+        start_receive();
+    });
+}
+
+void tcp_connection::stop()
+{
+    boost::asio::post(t_strand, [this]() { close(); });
+}
+
+/*
+ * Called by the sweep of the server. A free connection never looks idle, its clock is set when it starts
+ */
+void tcp_connection::close_if_idle(int64_t now, int idle_seconds)
+{
+    if (now - t_last_active.load(std::memory_order_relaxed) < idle_seconds)
+    {
+        return;
+    }
+    boost::asio::post(t_strand, [this, now, idle_seconds]() {
+        if (t_state == connection_open && now - t_last_active.load(std::memory_order_relaxed) >= idle_seconds)
+        {
+            std::cout << "TCP client " << t_client_address << " was idle for " << idle_seconds << " s" << std::endl;
+            close();
+        }
+    });
 }
 
 /*
- *  This functino is called when the asynchronous accept operation initiated by start_accept() finishes. It services the client request, and then calls start_accept() to initiate the next accept operation.
+ * Stops serving the client: the pending operations finish with an error and the last one frees the connection
  */
+void tcp_connection::close()
+{
+    if (t_state != connection_open)
+    {
+        return;
+    }
+    t_state = connection_closing;
+
+    boost::system::error_code ec;
+    t_socket.close(ec);
+    t_database->t_pending.cancel_all(&t_pending); // erase all commands of that client
+    t_database->unsubscribe(&t_subscriber);
+    t_subscriber.clear();
 
-tcp_connection::tcp_connection(boost::asio::io_service *io, office *database, communications *serial) : t_socket(*io), t_database(database), t_serial(serial), t_timer(*io)
+    t_operations++; // the close counts as one, so a connection without operations is freed too
+    finish_operation();
+}
+
+void tcp_connection::finish_operation()
 {
+    if (t_operations.fetch_sub(1) == 1 && t_state == connection_closing)
+    {
+        t_state = connection_free;
+        t_last_active = std::numeric_limits<int64_t>::max();
+        if (on_released)
+        {
+            on_released();
+        }
+    }
 }
 
 /*
- * Receives a new TCP client command
+ * Receives a new TCP client command, after the framed command cut by the previous read
  */
 void tcp_connection::start_receive()
 {
+    t_operations++;
     t_socket.async_read_some(
-        boost::asio::buffer(t_recv_buffer),
-        [this](const boost::system::error_code &error, std::size_t bytes_transferred) {
-            if (!error && bytes_transferred)
+        boost::asio::buffer(t_recv_buffer.data() + t_partial, t_recv_buffer.size() - 1 - t_partial), // room for the terminator
+        boost::asio::bind_executor(t_strand, make_memory_handler(t_handler_memory, [this](const boost::system::error_code &error, std::size_t bytes_transferred) {
+                                       if (!error && bytes_transferred && t_state == connection_open)
+                                       {
+                                           handle_receive(bytes_transferred);
+                                       }
+                                       else if (t_state == connection_open)
+                                       {
+                                           std::cout << "TCP client has left. " << t_client_address << std::endl;
+                                           close();
+                                       }
+                                       finish_operation();
+                                   })));
+}
+
+/*
+ * Process the commands of one read: the plain one, or every complete line of the framed protocol.
+ * Their answers are written together once they all ran.
+ */
+void tcp_connection::handle_receive(size_t bytes_transferred)
+{
+    t_last_active.store(steady_seconds(), std::memory_order_relaxed);
+    char *data = t_recv_buffer.data();
+    size_t size = t_partial + bytes_transferred;
+
+    if (!t_framed && data[0] == FRAME_TAG)
+    {
+        t_framed = true;
+        std::cout << "TCP client " << t_client_address << " speaks the framed protocol" << std::endl;
+    }
+
+    if (!t_framed)
+    {
+        data[size] = '\0';
+        run_command(data, -1);
+    }
+    else
+    {
+        char *line = data;
+        char *end = data + size;
+        char *newline;
+        while ((newline = static_cast<char *>(memchr(line, '\n', end - line))))
+        {
+            *newline = '\0';
+            if (newline > line && newline[-1] == '\r')
             {
-                handle_receive(error, bytes_transferred);
+                newline[-1] = '\0';
             }
-            else
+
+            // "#<tag> <command>", a line without tag is answered with the tag 0
+            char *command = line;
+            int64_t tag = 0;
+            if (*command == FRAME_TAG)
             {
-                std::cout << "TCP client has left. " << this << std::endl;
-                t_socket.close();
+                tag = std::max(0LL, std::strtoll(command + 1, &command, 10));
             }
-        });
+            while (*command == ' ')
+            {
+                command++;
+            }
+            if (*command)
+            {
+                run_command(command, tag);
+            }
+            line = newline + 1;
+        }
+
+        // keeps the start of the next command for the next read
+        t_partial = end - line;
+        if (t_partial == t_recv_buffer.size() - 1)
+        {
+            std::cout << "TCP client " << t_client_address << " sent a command longer than " << t_partial << " bytes, dropped" << std::endl;
+            t_partial = 0;
+        }
+        memmove(data, line, t_partial);
+    }
+
+    flush_replies();
+    if (t_queued >= REPLY_QUEUE_MAX) // reads again once the client takes its answers
+    {
+        t_receive_paused = true;
+        return;
+    }
+    start_receive();
 }
 
 /*
- * Process the command
+ * Runs one command, <tag> is the one of the framed protocol or -1
  */
-void tcp_connection::handle_receive(const boost::system::error_code &error, size_t bytes_transferred)
+void tcp_connection::run_command(char *command, int64_t tag)
 {
-    if (!error && bytes_transferred)
-    {
-        std::string command = std::string(t_recv_buffer.begin(), t_recv_buffer.begin() + bytes_transferred);
+    char order = 't';
+    char type = 't';
+    int address = -1;
+    float value = 0.0;
 
-        char order = 't';
-        char type = 't';
-        int address = -1;
-        float value = 0.0;
+    sscanf(command, "%d %c %c %f", &address, &order, &type, &value);
 
-        sscanf(command.c_str(), "%d %c %c %f", &address, &order, &type, &value);
+    std::cout << "Received: '" << order << ' ' << type << ' ' << address << ' ' << value << "\t"
+              << " tag: " << tag << ' ' << "command: " << command << std::endl;
 
-        std::cout << "Received: '" << order << ' ' << type << ' ' << address << ' ' << value << "\t"
-                  << " bytes received: " << bytes_transferred << ' ' << "command: " << command << std::endl;
+    // the answer is written straight into the buffer of the answers of this read
+    reply_writer response = begin_reply(tag);
+    response.put(type).put('\t').put_integer(address).put('\t');
+    int valid_response = 1; // 1: True , -1 : Fale, 0: do nothing, -2: err, 3: already answered, 4: ack
 
-        std::string response = std::string(1, type) + '\t' + std::to_string(address) + '\t';
-        int valid_response = 1; // 1: True , -1 : Fale, 0: do nothing
-
-        if (command.compare("r") == 0)
+    if (std::strcmp(command, "r") == 0)
+    {
+        valid_response = 0;
+        if (t_database->t_pending.submit(&t_pending, 'A', 0, 0, tag)) // answered by the greeting of the hub after the restart
         {
             t_serial->write_command("+rrrr");
-            t_database->t_clients_address.push_back(t_client_address); // appends the clients address
-            t_database->t_clients_command.push_back("A00");            // appends the new command --- to be equal as the order instructions
-            t_database->t_acknowledge.push_back(-2);
-            valid_response = 0;
         }
-        else if (0 > address || address > t_database->get_num_lamps())
+        else
         {
-            valid_response = -1;
+            valid_response = -2;
         }
-        else
+    }
+    else if (0 > address || address > t_database->get_num_lamps() || !std::isfinite(value)) // "inf" and "nan" are no seconds, threshold or setting
+    {
+        valid_response = -1;
+    }
+    else if (order == 'w' || order == 'W') // follow or stop following value <type> of desk <i>
+    {
+        valid_response = subscribe(order, type, address, value, tag) == 1 ? 4 : -2;
+    }
+    else
+    {
+        switch (order)
+        {
+        case 'g':
         {
-            switch (order)
+            switch (type)
             {
-            case 'g':
+            case 'e': // get accumulated energy consumption in the system <T> or at desk <i> since the last restart, or in the last <value> seconds
             {
-                switch (type)
-                {
-                case 'e': // get accumulated energy consumption in the system <T> or at desk <i> since the last restart
+                response.put_number(value > 0 ? t_database->get_window_metrics(address, value).energy : address == 0 ? t_database->get_accumulated_energy_consumption() : t_database->desk(address).get_accumulated_energy_consumption_at_desk());
+                break;
+            }
+            case 'f': // get flicker error in the system <T> or at desk <i> since the last restart, or in the last <value> seconds
+            {
+                response.put_number(value > 0 ? t_database->get_window_metrics(address, value).flicker : address == 0 ? t_database->get_accumulated_flicker_error() : t_database->desk(address).get_accumulated_flicker_error_at_desk());
+                break;
+            }
+            case 'p': // get instantaneous power consumption in the system <T> or at desk <i>, or its mean in the last <value> seconds
+            {
+                response.put_number(value > 0 ? t_database->get_window_metrics(address, value).power : address == 0 ? t_database->get_instant_power() : t_database->desk(address).get_instant_power_at_desk());
+                break;
+            }
+            case 'v': // get visibility error in the system <T> or at desk <i> since the last restart, or in the last <value> seconds
+            {
+                response.put_number(value > 0 ? t_database->get_window_metrics(address, value).visibility : address == 0 ? t_database->get_accumulated_visibility_error() : t_database->desk(address).get_accumulated_visibility_error_at_desk());
+                break;
+            }
+            case 'c': // get current cost energy at desk <i>
+            {
+                if (address == 0)
                 {
-                    response += std::to_string(address == 0 ? t_database->get_accumulated_energy_consumption() : t_database->t_lamps_array[address - 1]->get_accumulated_energy_consumption_at_desk());
-                    break;
+                    valid_response = -1;
                 }
-                case 'f': // get flicker error in the system <T> or at desk <i> since the last restart
+                else
                 {
-                    response += std::to_string(address == 0 ? t_database->get_accumulated_flicker_error() : t_database->t_lamps_array[address - 1]->get_accumulated_flicker_error_at_desk());
-                    break;
+                    response.put_number(t_database->desk(address).get_nominal_power());
                 }
-                case 'p': // get instantaneous power consumption in the system <T> or at desk <i>
+                break;
+            }
+            case 'd': // get current duty cicle at luminance at desk <i>
+            {
+                if (address == 0)
                 {
-                    response += std::to_string(address == 0 ? t_database->get_instant_power() : t_database->t_lamps_array[address - 1]->get_instant_power_at_desk());
-                    break;
+                    valid_response = -1;
                 }
-                case 'v': // get visibility error in the system <T> or at desk <i> since the last restart
+                else
                 {
-                    response += std::to_string(address == 0 ? t_database->get_accumulated_visibility_error() : t_database->t_lamps_array[address - 1]->get_accumulated_visibility_error_at_desk());
-                    break;
+                    response.put_number(t_database->desk(address).t_duty_cicle.get_newest());
                 }
-                case 'c': // get current cost energy at desk <i>
+                break;
+            }
+            case 'l': // get current illuminance at luminance at desk <i>
+            {
+                if (address == 0)
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->get_nominal_power());
-                    }
-                    break;
+                    valid_response = -1;
                 }
-                case 'd': // get current duty cicle at luminance at desk <i>
+                else
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->t_duty_cicle.get_newest());
-                    }
-                    break;
+                    response.put_number(t_database->desk(address).t_luminance.get_newest());
                 }
-                case 'l': // get current illuminance at luminance at desk <i>
+                break;
+            }
+            case 'L': // get current illuminance lower bound at desk <i>
+            {
+                if (address == 0)
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->t_luminance.get_newest());
-                    }
-                    break;
+                    valid_response = -1;
                 }
-                case 'L': // get current illuminance lower bound at desk <i>
+                else
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->get_state() == false ? t_database->t_lamps_array[address - 1]->get_unoccupied_value() : t_database->t_lamps_array[address - 1]->get_occupied_value());
-                    }
-                    break;
+                    response.put_number(t_database->desk(address).get_state() == false ? t_database->desk(address).get_unoccupied_value() : t_database->desk(address).get_occupied_value());
                 }
-                case 'O': // get lower bound on illuminance for Occupied state at desk <i>
-                {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->get_occupied_value());
-                    }
-                    break;
-                }
-                case 'o': // get current occupancy state at desk <i>
+                break;
+            }
+            case 'O': // get lower bound on illuminance for Occupied state at desk <i>
+            {
+                if (address == 0)
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->get_state());
-                    }
-                    break;
+                    valid_response = -1;
                 }
-                case 't': // get elapsed time since last restart
+                else
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->get_elapesd_time_since_last_restart());
-                    }
-                    break;
+                    response.put_number(t_database->desk(address).get_occupied_value());
                 }
-                case 'U': // get lower bound on illuminance for Unoccupied state at desk <i>
+                break;
+            }
+            case 'o': // get current occupancy state at desk <i>
+            {
+                if (address == 0)
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        response += std::to_string(t_database->t_lamps_array[address - 1]->get_unoccupied_value());
-                    }
-                    break;
+                    valid_response = -1;
                 }
-                // direct to arduino
-                case 'r': // get current illuminance control reference at desk <i>
-                case 'x': // get current external illuminace at desk <i>
+                else
                 {
-                    if (address == 0)
-                    {
-                        valid_response = -1;
-                    }
-                    else
-                    {
-                        std::string client_msg = std::string(1, type) + std::to_string(address);
-                        // command already in stack
-                        if (std::find(t_database->t_clients_command.begin(), t_database->t_clients_command.end(), client_msg) != t_database->t_clients_command.end())
-                        {
-                            send_acknowledgement(false);
-                        }
-                        else
-                        {
-                            valid_response = 0;
-                            std::string to_arduino = '+' + client_msg + "**";
-                            t_serial->write_command(to_arduino);
-                            t_database->t_clients_address.push_back(t_client_address);
-                            t_database->t_clients_command.push_back(client_msg); // appends the new command
-                            t_database->t_acknowledge.push_back(-2);
-                        }
-                    }
-                    break;
+                    response.put_integer(t_database->desk(address).get_state());
                 }
-                default:
+                break;
+            }
+            case 't': // get elapsed time since last restart
+            {
+                if (address == 0)
                 {
                     valid_response = -1;
-                    break;
                 }
+                else
+                {
+                    response.put_number(t_database->get_elapesd_time_since_last_restart());
                 }
                 break;
             }
-            case 'c': // set current energy cost at desk <x>
+            case 'U': // get lower bound on illuminance for Unoccupied state at desk <i>
             {
                 if (address == 0)
                 {
                     valid_response = -1;
                 }
-                else if (value >= 0) // acceptable value
-                {
-                    valid_response = 2; // do nothing
-                }
                 else
                 {
-                    valid_response = 0; // do nothing
-                    send_acknowledgement(false);
+                    response.put_number(t_database->desk(address).get_unoccupied_value());
                 }
                 break;
             }
-            case 'O': // set lower bound on illuminance for Occupied state at desk <i>
+            case 'S': // get minimum, maximum, mean and standard deviation of the last minute of variable <x> ('l' or 'd') at desk <i>
             {
-                if (address == 0)
+                char variable = 0;
+                sscanf(command, "%*d %*c %*c %c", &variable);
+                if (address == 0 || (variable != 'l' && variable != 'd'))
                 {
                     valid_response = -1;
                 }
-                else if (value >= 0 && value > t_database->t_lamps_array[address - 1]->get_unoccupied_value()) // acceptable value
-                {
-                    valid_response = 2; // do nothing
-                }
                 else
                 {
-                    valid_response = 0; // do nothing
-                    send_acknowledgement(false);
+                    series_stats stats = t_database->desk(address).get_last_minute_stats(variable);
+                    response.put(variable).put('\t').put_number(stats.min).put('\t').put_number(stats.max).put('\t');
+                    response.put_number(stats.mean).put('\t').put_number(stats.stddev).put('\t').put_integer(stats.count);
                 }
                 break;
             }
-            case 'o': // set current occupancy state at desk <i>
+            case 'T': // get every value of every desk and the totals of the system at once, as a table
             {
-                if (address == 0)
+                send_snapshot(response);
+                valid_response = 3;
+                break;
+            }
+            case 'A': // get value <x> (one of DESK_COLUMNS) of all desks at once, with their sum, minimum and maximum
+            {
+                char variable = 0;
+                float values[MAX_DESKS];
+                sscanf(command, "%*d %*c %*c %c", &variable);
+                size_t n_desks = t_database->get_all_desks(variable, values);
+                if (n_desks == 0)
                 {
                     valid_response = -1;
                 }
-                else if (value >= 0) // acceptable value
-                {
-                    value = value < 0.05 ? (int)0 : (int)1;
-                    valid_response = 2; // do nothing
-                }
                 else
                 {
-                    valid_response = 0; // do nothing
-                    send_acknowledgement(false);
+                    range_sums sums;
+                    accumulate_range(values, n_desks, sums);
+                    response.put(variable).put('\t').put_number(sums.sum).put('\t').put_number(sums.min).put('\t').put_number(sums.max);
+                    for (size_t i = 0; i < n_desks; i++)
+                    {
+                        response.put('\t').put_number(values[i]);
+                    }
                 }
                 break;
             }
-            case 'U': // set lower bound on illuminance for Unoccupied state at desk <i>
+            // direct to arduino
+            case 'r': // get current illuminance control reference at desk <i>
+            case 'x': // get current external illuminace at desk <i>
             {
                 if (address == 0)
                 {
                     valid_response = -1;
                 }
-                else if (value >= 0 && value < t_database->t_lamps_array[address - 1]->get_occupied_value()) // acceptable value
-                {
-                    valid_response = 2; // do nothing
-                }
                 else
                 {
-                    valid_response = 0; // do nothing
-                    send_acknowledgement(false);
+                    valid_response = 0;
+                    if (t_database->t_pending.submit(&t_pending, type, address, 0, tag)) // not already in stack
+                    {
+                        std::string to_arduino = '+' + std::string(1, type) + std::to_string(address) + "**";
+                        t_serial->write_command(to_arduino);
+                    }
+                    else
+                    {
+                        valid_response = -2;
+                    }
                 }
                 break;
             }
@@ -450,126 +802,411 @@ void tcp_connection::handle_receive(const boost::system::error_code &error, size
                 break;
             }
             }
+            break;
         }
-        if (valid_response == -1) // invalid command
+        case 'c': // set current energy cost at desk <x>
         {
-            response = "The number of Total desks connected in the network is: " + std::to_string(t_database->get_num_lamps());
-            valid_response = 1;
+            if (address == 0)
+            {
+                valid_response = -1;
+            }
+            else if (value >= 0) // acceptable value
+            {
+                valid_response = 2; // do nothing
+            }
+            else
+            {
+                valid_response = -2; // not acceptable
+            }
+            break;
         }
-
-        if (valid_response == 1) // there is a response to send
+        case 'O': // set lower bound on illuminance for Occupied state at desk <i>
         {
-            send_string(response);
+            if (address == 0)
+            {
+                valid_response = -1;
+            }
+            else if (value >= 0 && value > t_database->desk(address).get_unoccupied_value()) // acceptable value
+            {
+                valid_response = 2; // do nothing
+            }
+            else
+            {
+                valid_response = -2; // not acceptable
+            }
+            break;
         }
-        else if (valid_response == 2) // get command
+        case 'o': // set current occupancy state at desk <i>
         {
-            int int_value = round(value * 10);
-            std::string client_msg = std::string(1, order) + std::to_string(address) + std::to_string(int_value); // in this case the var order is the type once it is a set command
-            std::cout << t_client_address << "\t" << client_msg << std::endl;
-
-            // command already in stack
-            if (std::find(t_database->t_clients_command.begin(), t_database->t_clients_command.end(), client_msg) != t_database->t_clients_command.end())
+            if (address == 0)
+            {
+                valid_response = -1;
+            }
+            else if (value >= 0) // acceptable value
             {
-                send_acknowledgement(false);
+                value = value < 0.05 ? (int)0 : (int)1;
+                valid_response = 2; // do nothing
             }
             else
             {
-                u_int8_t val[2]{};                                                                                                                            // 2 bytes with float value
-                t_database->float_2_bytes(value, val);                                                                                                        // converts the float to 12 decimal bit and 4 floats
-                std::string to_arduino = '+' + std::string(1, order) + std::to_string(address) + std::string(1, (char)val[1]) + std::string(1, (char)val[0]); // msg to be sent
-                t_serial->write_command(to_arduino);                                                                                                          // sent message
-                t_database->t_clients_address.push_back(t_client_address);                                                                                    // appends the clients address
-                t_database->t_clients_command.push_back(client_msg);                                                                                          // appends the new command
-                t_database->t_acknowledge.push_back(-2);                                                                                                       // appends the arduino response
+                valid_response = -2; // not acceptable
             }
+            break;
         }
+        case 'U': // set lower bound on illuminance for Unoccupied state at desk <i>
+        {
+            if (address == 0)
+            {
+                valid_response = -1;
+            }
+            else if (value >= 0 && value < t_database->desk(address).get_occupied_value()) // acceptable value
+            {
+                valid_response = 2; // do nothing
+            }
+            else
+            {
+                valid_response = -2; // not acceptable
+            }
+            break;
+        }
+        default:
+        {
+            valid_response = -1;
+            break;
+        }
+        }
+    }
+    if (valid_response == -1) // invalid command
+    {
+        response.clear();
+        response.put("The number of Total desks connected in the network is: ").put_integer(t_database->get_num_lamps());
+        valid_response = 1;
+    }
 
-        start_receive();
+    if (valid_response == 1) // there is a response to send
+    {
+        response.put('\n');
+    }
+    else if (valid_response != 3)
+    {
+        cancel_reply();
+    }
+
+    if (valid_response == -2 || valid_response == 4)
+    {
+        send_acknowledgement(valid_response == 4, tag);
+    }
+
+    if (valid_response == 2) // get command
+    {
+        int int_value = std::lround(value * 10);
+        uint64_t id = t_database->t_pending.submit(&t_pending, order, address, int_value, tag); // in this case the var order is the type once it is a set command
+        if (DEBUG)
+            std::cout << t_client_address << "\t request " << id << ": " << order << address << ' ' << int_value << std::endl;
+
+        if (!id) // command already in stack
+        {
+            send_acknowledgement(false, tag);
+        }
+        else
+        {
+            u_int8_t val[2]{};                                                                                                                            // 2 bytes with float value
+            t_database->float_2_bytes(value, val);                                                                                                        // converts the float to 12 decimal bit and 4 floats
+            std::string to_arduino = '+' + std::string(1, order) + std::to_string(address) + std::string(1, (char)val[1]) + std::string(1, (char)val[0]); // msg to be sent
+            t_serial->write_command(to_arduino);                                                                                                          // sent message
+        }
     }
 }
 
 /*
  * Sends wheater the information was accepted 'ack' or not 'err'
  */
-void tcp_connection::send_acknowledgement(bool ack_err)
+void tcp_connection::send_acknowledgement(bool ack_err, int64_t tag)
 {
-    std::string response = (std::string("\t\t\t\t\t\t\t\t")) + (ack_err ? "ack" : "err");
+    reply_writer reply = begin_reply(tag);
+    if (tag < 0)
+    {
+        reply.put("\t\t\t\t\t\t\t\t").put(ack_err ? "ack" : "err");
+    }
+    else
+    {
+        reply.put(ack_err ? "ack" : "err").put('\n');
+    }
+}
+
+/*
+ * Starts the next answer in the buffer of the answers, "#<tag> " when it has a tag.
+ * The buffer is sent first when the longest answer would not fit.
+ */
+reply_writer tcp_connection::begin_reply(int64_t tag)
+{
+    if (t_batch && REPLY_BUFFER_BYTES - t_batch->size < REPLY_MAX_BYTES)
+    {
+        flush_replies();
+    }
+    if (!t_batch)
+    {
+        t_batch = t_replies.acquire();
+    }
+    t_reply_start = t_batch->size;
+    if (tag >= 0)
+    {
+        reply_writer(t_batch, true).put(FRAME_TAG).put_integer(tag).put(' ');
+    }
+    return reply_writer(t_batch, true);
+}
+
+/*
+ * Continues the answer being formatted, in a new buffer when <room> bytes do not fit.
+ * The part already formatted may have been sent.
+ */
+reply_writer tcp_connection::continue_reply(size_t room)
+{
+    if (REPLY_BUFFER_BYTES - t_batch->size < room)
+    {
+        flush_replies();
+        t_batch = t_replies.acquire();
+    }
+    return reply_writer(t_batch, true);
+}
 
-    t_socket.async_send(boost::asio::buffer(response.c_str(), response.size()),
-                        [response](const boost::system::error_code &t_ec, std::size_t len) {
-                            std::cout << response << std::endl;
-                        });
+/*
+ * Answer of 'g T': "T\t0\t<desks>\t<seconds since the last restart>", then a CSV table of <desks> + 2 lines, the
+ * names of the columns, the totals of the system as desk 0 and one line per desk. All the values are of the same
+ * batch of frames.
+ */
+void tcp_connection::send_snapshot(reply_writer &response)
+{
+    if (!t_snapshot)
+    {
+        t_snapshot.reset(new office_snapshot);
+    }
+    const office_snapshot &snapshot = *t_snapshot;
+    t_database->get_snapshot(*t_snapshot);
+
+    response.put_integer(snapshot.n_desks).put('\t').put_number(snapshot.seconds).put('\n');
+    response.put("desk,e,p,v,f,c,d,l,L,O,U,o\n");
+    response.put("0,").put_number(snapshot.totals.energy).put(',').put_number(snapshot.totals.power).put(',');
+    response.put_number(snapshot.totals.visibility).put(',').put_number(snapshot.totals.flicker).put(",,,,,,,\n");
+
+    const desk_columns &desks = snapshot.desks;
+    for (int i = 0; i < snapshot.n_desks; i++)
+    {
+        reply_writer row = continue_reply(SNAPSHOT_ROW_BYTES);
+        row.put_integer(i + 1).put(',').put_number(desks.energy[i]).put(',').put_number(desks.power[i]).put(',');
+        row.put_number(desks.visibility[i]).put(',').put_number(desks.flicker[i]).put(',').put_number(desks.cost[i]).put(',');
+        row.put_number(desks.duty_cicle[i]).put(',').put_number(desks.luminance[i]).put(',');
+        row.put_number(desks.state[i] ? desks.occupied[i] : desks.unoccupied[i]).put(',');
+        row.put_number(desks.occupied[i]).put(',').put_number(desks.unoccupied[i]).put(',').put_integer((int)desks.state[i]).put('\n');
+    }
 }
 
 /*
- * Sends string
+ * Forgets the answer being formatted, with its tag
  */
-void tcp_connection::send_string(std::string s)
+void tcp_connection::cancel_reply()
 {
-    s += '\n';
-    t_socket.async_send(boost::asio::buffer(s.c_str(), s.size()),
-                        [s](const boost::system::error_code &t_ec, std::size_t len) {
-                            std::cout << s << std::endl;
-                        });
+    t_batch->size = t_reply_start;
+}
+
+/*
+ * Sends the answers formatted so far
+ */
+void tcp_connection::flush_replies()
+{
+    reply_buffer *batch = t_batch;
+    t_batch = nullptr;
+    if (batch && batch->size)
+    {
+        send_reply(batch);
+    }
+    else if (batch)
+    {
+        t_replies.release(batch);
+    }
+}
+
+/*
+ * Queues answers to be written, the buffer goes back to the pool when it is written
+ */
+void tcp_connection::send_reply(reply_buffer *reply)
+{
+    if (t_state != connection_open)
+    {
+        t_replies.release(reply);
+        return;
+    }
+
+    reply->next = nullptr;
+    if (t_queue_tail)
+    {
+        t_queue_tail->next = reply;
+    }
+    else
+    {
+        t_queue_head = reply;
+    }
+    t_queue_tail = reply;
+    if (t_queued++ == 0) // nothing being written
+    {
+        write_next();
+    }
+}
+
+/*
+ * Writes the first answers of the queue, one write at a time so the answers are never interleaved
+ */
+void tcp_connection::write_next()
+{
+    reply_buffer *reply = t_queue_head;
+    t_operations++;
+    boost::asio::async_write(t_socket, boost::asio::buffer(reply->data, reply->size),
+                             boost::asio::bind_executor(t_strand, make_memory_handler(t_handler_memory, [this, reply](const boost::system::error_code &t_ec, std::size_t len) {
+                                                            std::cout.write(reply->data, reply->size) << std::endl;
+                                                            t_queue_head = reply->next;
+                                                            t_queued--;
+                                                            t_replies.release(reply);
+
+                                                            if (t_ec || t_state != connection_open) // the rest will never be written
+                                                            {
+                                                                while (t_queue_head)
+                                                                {
+                                                                    reply_buffer *next = t_queue_head->next;
+                                                                    t_replies.release(t_queue_head);
+                                                                    t_queue_head = next;
+                                                                }
+                                                                t_queued = 0;
+                                                                close();
+                                                            }
+                                                            else if (t_queue_head)
+                                                            {
+                                                                write_next();
+                                                            }
+                                                            if (!t_queue_head)
+                                                            {
+                                                                t_queue_tail = nullptr;
+                                                            }
+
+                                                            if (t_receive_paused && t_queued < REPLY_QUEUE_MAX && t_state == connection_open)
+                                                            {
+                                                                t_receive_paused = false;
+                                                                start_receive();
+                                                            }
+                                                            if (t_changes_waiting && t_queued < REPLY_QUEUE_MAX)
+                                                            {
+                                                                t_changes_waiting = false;
+                                                                deliver_changes();
+                                                            }
+                                                            finish_operation();
+                                                        })));
 }
 
 /*
- * Checks asynchronous if the database as a new information valid or not
+ * Sends the answers of the hub to the commands of this client, as soon as they arrive
  */
-void tcp_connection::start_timer()
+void tcp_connection::deliver_completed()
 {
-    t_timer.expires_after(boost::asio::chrono::milliseconds{1500}); // it takes in avergare 1s and 500ms
-    t_timer.async_wait([this](const boost::system::error_code &t_ec) {
-        bool last_call = false;
-        if (t_ec || !t_socket.is_open())
+    if (t_state != connection_open) // the client left, the connection may be accepting the next one
+    {
+        return;
+    }
+
+    t_completed.clear();
+    t_database->t_pending.take_completed(&t_pending, t_completed);
+    for (size_t i = 0; i < t_completed.size(); i++)
+    {
+        const completed_request &request = t_completed[i];
+        if (DEBUG)
+            std::cout << "The request \t " << request.id << ' ' << request.opcode << request.desk
+                      << "\t poped out to \t" << t_client_address << "\t with the value \t" << request.result << std::endl;
+
+        if (request.opcode == 'x' || request.opcode == 'r') // get command
         {
-            last_call = true; // erase all commands of that client
+            begin_reply(request.tag).put_integer(request.desk).put('\t').put(request.opcode).put('\t').put_number(request.result / 10.0).put('\n');
         }
-
-        // delete index from the last when the client is done
-        std::vector<int>::size_type sz = t_database->t_clients_address.size();
-        for (int clt = sz - 1; clt >= 0; clt--)
+        else // set commands wainting for acknoledge
         {
-            std::cout << "Queue of waiting for acknowledge instructions.\nNumber of pendent instructions:\t" << sz << std::endl;
-            std::cout << "Client's id:\t" << t_client_address << "\t message :\t" << t_database->t_clients_command.at(clt) << std::endl;
+            send_acknowledgement(request.result == 1, request.tag);
+        }
+    }
+    flush_replies();
+}
 
-            if (!t_database->t_clients_address.at(clt).compare(t_client_address)) // client has a pendent process
-            {
-                std::cout << "Waiting message value:" << t_database->t_acknowledge.at(clt) << std::endl;
+/*
+ * Follows ('w') or stops following ('W') value <type> of desk <address>, or of the system when it is 0, with '*' for
+ * every value of the desk
+ * returns 1, or -1 when the value can not be followed
+ */
+int tcp_connection::subscribe(char order, char type, int address, float threshold, int64_t tag)
+{
+    const char *types = address == 0 ? "epvf" : DESK_COLUMNS; // the system has the totals only
+    if ((type != '*' && !std::strchr(types, type)) || type == '\0' || threshold < 0)
+    {
+        return -1;
+    }
 
-                if ((t_database->t_acknowledge.at(clt) == -2) && !last_call)
-                {
-                    continue;
-                }
-                // 'ack' to be sent
-                if (!last_call)
-                {
-                    if (((char)t_database->t_clients_command.at(clt)[0] == 'x') || ((char)t_database->t_clients_command.at(clt)[0] == 'r')) // get command
-                    {
-                        std::string response = std::string(1, (char)t_database->t_clients_command.at(clt)[1]) + '\t' +
-                                               std::string(1, (char)t_database->t_clients_command.at(clt)[0]) + '\t' +
-                                               std::to_string(t_database->t_acknowledge.at(clt) / 10.0);
-                        send_string(response);
-                    }
+    int result = 1;
+    if (type != '*')
+    {
+        result = order == 'w' ? t_subscriber.watch(address, type, threshold, tag) : t_subscriber.unwatch(address, type);
+    }
+    else if (order == 'w')
+    {
+        for (const char *t = types; *t && result == 1; t++)
+        {
+            result = t_subscriber.watch(address, *t, threshold, tag);
+        }
+    }
+    else
+    {
+        for (const char *t = types; *t; t++)
+        {
+            t_subscriber.unwatch(address, *t); // the ones followed
+        }
+    }
 
-                    else // set commands wainting for acknoledge
-                    {
-                        send_acknowledgement(t_database->t_acknowledge.at(clt) == 1 ? true : false);
-                    }
-                }
-                // erase commands
-                std::cout << "The command \t " << t_database->t_clients_command.at(clt)
-                          << "\t poped out to \t" << t_database->t_clients_address.at(clt)
-                          << "\t with the value \t" << t_database->t_acknowledge.at(clt) << std::endl;
+    if (t_subscriber.empty())
+    {
+        t_database->unsubscribe(&t_subscriber);
+    }
+    else
+    {
+        t_database->subscribe(&t_subscriber);
+    }
+    return result;
+}
 
-                t_database->t_acknowledge.erase(t_database->t_acknowledge.begin() + clt);
-                t_database->t_clients_command.erase(t_database->t_clients_command.begin() + clt); // if the clients wants to know the command, print this before send teh acknowledge
-                t_database->t_clients_address.erase(t_database->t_clients_address.begin() + clt);
-            }
+/*
+ * Sends the changes of the values followed by the client, unless it is not reading: then they keep being coalesced
+ * until its answers are written
+ */
+void tcp_connection::deliver_changes()
+{
+    if (t_state != connection_open)
+    {
+        return;
+    }
+    if (t_queued >= REPLY_QUEUE_MAX)
+    {
+        t_changes_waiting = true;
+        return;
+    }
+
+    t_subscriber.take(t_changes);
+    for (size_t i = 0; i < t_changes.size(); i++)
+    {
+        const metric_delta &change = t_changes[i];
+        reply_writer reply = begin_reply(change.tag);
+        reply.put(change.type).put('\t').put_integer(change.desk).put('\t');
+        if (change.type == 'o')
+        {
+            reply.put_integer((int)change.value);
         }
-        if (!last_call)
+        else
         {
-            start_timer();
+            reply.put_number(change.value);
         }
-    });
-}
\ No newline at end of file
+        reply.put('\n');
+    }
+    flush_replies();
+}
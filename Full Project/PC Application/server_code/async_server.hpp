@@ -4,7 +4,8 @@
 #define BOOST_BIND_GLOBAL_PLACEHOLDERS
 #include <iostream>
 #include <string>  // for std::string
-#include <sstream> //for std::stringstream
+#include <functional>
+#include <limits>
 #include <boost/array.hpp>
 #include <boost/bind.hpp>
 #include <boost/shared_ptr.hpp>
@@ -13,6 +14,15 @@
 
 #include "database.hpp"
 #include "serial.hpp"
+#include "reply_pool.hpp"
+
+#define UDP_VALUE_BYTES 48 // room for a float in "%f"
+#define MAX_CONNECTIONS 64          // TCP clients at once, the next ones are refused
+#define IDLE_TIMEOUT_SECONDS 1800   // a TCP client that sends nothing for this long is closed, 0 never
+#define IDLE_SWEEP_SECONDS 30       // how often the idle clients are looked for
+#define FRAME_TAG '#'               // first character of a command of the framed protocol
+#define REPLY_QUEUE_MAX 16          // answers waiting to be written before the connection stops reading
+#define SNAPSHOT_ROW_BYTES 640      // longest line of the table of 'g T': a desk and its 11 values
 
 /* --------------------------------------------------------------------------------
    |                                  UDP                                        |
@@ -26,19 +36,31 @@ class udp_server
 private:
     void start_receive();
     void handle_receive(const boost::system::error_code &error, size_t bytes_transferred);
-    void send_last_minute(std::string header, char type, int address, udp::endpoint remote_endpoint);
+    void send_last_minute(const char *header, char order, char type, int address, udp::endpoint remote_endpoint);
+    void send_history(char order, char type, int address, float seconds, udp::endpoint remote_endpoint);
+    void send_values(const char *header, const float *values, size_t n_values, udp::endpoint remote_endpoint);
+    void send_batch(char order, char type, int address, const float *values, size_t n_values, udp::endpoint remote_endpoint);
     void set_stream(char type, int address, udp::endpoint remote_endpoint);
+    void set_binary_stream(char type, int address, udp::endpoint remote_endpoint);
     void send_acknowledgement(bool ack_err);
+    void send_reply(reply_buffer *reply);
 
     office *t_database;
 
     udp::socket t_socket;
+    boost::asio::io_context::strand t_strand; // the receive chain and every send, also the ones of the streams
     udp::endpoint t_remote_endpoint;
     boost::array<char, 1024> t_recv_buffer;
+    std::unique_ptr<float[]> t_last_minute; // snapshot of one history ring, reused by every dump
+    std::vector<float> t_history_values;    // decoded history, reused by every dump
+    uint32_t t_transfers = 0;               // identifies each batched dump
+    reply_pool t_replies;                   // the answers, taken and returned in the strand
+    handler_memory t_handler_memory;        // the receive and the sends of the answers
 
 public:
     udp_server(boost::asio::io_service *io, unsigned short port, office *database);
     ~udp_server() { t_socket.close(); };
+    void stop();
 };
 
 /* --------------------------------------------------------------------------------------
@@ -48,22 +70,90 @@ public:
 
 using boost::asio::ip::tcp;
 
-class tcp_connection //: public boost::enable_shared_from_this<tcp_connection>
+/*
+ * One TCP client. The tcp_server keeps a fixed set of them and reuses each one for the next client once it is free:
+ * its socket, buffers and pools are kept, so clients coming and going cost no memory.
+ *
+ * A client speaks one of two protocols, chosen by its first command:
+ *  - plain: each read holds one command, e.g. "1ge", and gets one answer;
+ *  - framed, when the command starts with FRAME_TAG: one command per line, tagged with a number the client chooses,
+ *    e.g. "#12 1ge\n#13 0gp\n", and each answer is one line with the same tag, e.g. "#12 e\t1\t0.500000\n" - the
+ *    table of 'g T' follows the first line of its answer, which tells its size.
+ *
+ * In both, "<i>w<x> <threshold>" follows value <x> of desk <i> (of the system when <i> is 0): the server pushes it,
+ * like the answer of "<i>g<x>" and with the tag of the 'w', whenever it moved more than <threshold>, at most
+ * PUBLISH_HZ times per second. "<i>W<x>" stops it, and <x> '*' means every value of the desk.
+ *    Many commands may come in one write. The answers the server knows are sent in order, in as few writes as
+ *    possible; the ones of the hub are sent when the hub answers.
+ *
+ * Every asynchronous operation that refers to the connection (the read, the writes and the deliveries of the answers
+ * of the hub) is counted, and the connection tells the server it is free only when the client has left and none of
+ * them is left.
+ */
+class tcp_connection
 {
 
 private:
+    enum connection_state
+    {
+        connection_free,    // waiting for a client
+        connection_open,    // serving one
+        connection_closing, // the client left, some operations have not finished yet
+    };
+
     tcp::socket t_socket;
     office *t_database;
     communications *t_serial;
 
-    std::stringstream t_ss{};
+    boost::asio::io_context::strand t_strand; // receives the commands and delivers the answers of the hub
+    connection_state t_state = connection_free; // only touched in the strand
+    std::atomic<int> t_operations{0};          // operations in flight, the ingest adds the deliveries
+    std::atomic<int64_t> t_last_active{std::numeric_limits<int64_t>::max()}; // seconds of the steady clock, read by the idle sweep
+    boost::array<char, 1024> t_recv_buffer;
+    size_t t_partial = 0;  // start of t_recv_buffer: a framed command cut by the end of the previous read
+    bool t_framed = false; // the client speaks the framed protocol
+
+    pending_list t_pending;                      // commands waiting for the hub
+    std::vector<completed_request> t_completed; // answers being delivered, reused
+    std::unique_ptr<office_snapshot> t_snapshot; // copy of the office for 'g T', made on its first use and reused
 
-    boost::asio::steady_timer t_timer;
+    metric_subscriber t_subscriber;      // values followed by the client
+    std::vector<metric_delta> t_changes; // changes being delivered, reused
+    bool t_changes_waiting = false;      // the client is not reading, the changes wait in t_subscriber
+
+    reply_pool t_replies;            // the answers, taken and returned in the strand
+    handler_memory t_handler_memory; // the receive and the writes of the answers
+
+    reply_buffer *t_batch = nullptr; // answers of the commands of the current read, written once they all ran
+    size_t t_reply_start = 0;        // where the answer being formatted starts in t_batch
+    reply_buffer *t_queue_head = nullptr; // answers waiting to be written, one write at a time
+    reply_buffer *t_queue_tail = nullptr;
+    size_t t_queued = 0;
+    bool t_receive_paused = false; // REPLY_QUEUE_MAX answers are queued: the client is not reading them
+
+    void start_receive();
+    void handle_receive(size_t bytes_transferred);
+    void run_command(char *command, int64_t tag);
+    void send_acknowledgement(bool ack_err, int64_t tag);
+    reply_writer begin_reply(int64_t tag);
+    reply_writer continue_reply(size_t room);
+    void send_snapshot(reply_writer &response);
+    int subscribe(char order, char type, int address, float threshold, int64_t tag);
+    void deliver_changes();
+    void cancel_reply();
+    void flush_replies();
+    void send_reply(reply_buffer *reply);
+    void write_next();
+    void deliver_completed();
+    void close();
+    void finish_operation();
 
 public:
     tcp_connection(boost::asio::io_service *io, office *database, communications *serial);
     ~tcp_connection()
     {
+        t_database->t_pending.cancel_all(&t_pending);
+        t_database->unsubscribe(&t_subscriber);
         if (t_socket.is_open())
         {
             t_socket.close();
@@ -71,42 +161,42 @@ public:
     }
 
     std::string t_client_address;
-    void new_client()
-    {
-        t_ss << &t_socket;
-        t_client_address = t_ss.str();
-    }
-    tcp::socket &socket()
-    {
-        new_client();
-        return t_socket;
-    }
+    std::function<void()> on_released; // called, from the strand of the connection, when it is free again
 
-    boost::array<char, 1024> t_recv_buffer;
-
-    void start_receive();
-    void handle_receive(const boost::system::error_code &error, size_t bytes_transferred);
-    void send_acknowledgement(bool ack_err);
-    void send_string(std::string s);
-    void start_timer();
+    tcp::socket &socket() { return t_socket; }
+    void start();
+    void stop();
+    void close_if_idle(int64_t now, int idle_seconds);
 };
 
+/*
+ * Accepts the TCP clients into a bounded set of reusable connections and closes the ones that stay idle
+ */
 class tcp_server
 {
 private:
     void start_accept();
+    tcp_connection *take_connection();
+    void start_sweep();
 
-    tcp_connection *new_connection;
-    std::vector<tcp_connection *> connections;
+    std::vector<std::unique_ptr<tcp_connection>> t_connections; // every connection created, at most t_max_connections
+    std::vector<tcp_connection *> t_free;                       // the ones waiting for a client
     office *t_database;
     communications *t_serial;
+    const size_t t_max_connections;
+    const int t_idle_seconds;
 
     boost::asio::io_service *t_io;
+    boost::asio::io_context::strand t_strand; // the accepts, the sweeps and the lists of connections
     tcp::acceptor t_acceptor;
+    tcp::socket t_refused; // a client over the limit, closed as soon as it is accepted
+    boost::asio::steady_timer t_sweep;
 
 public:
-    tcp_server(boost::asio::io_service *io, unsigned short port, office *database, communications *serial);
+    tcp_server(boost::asio::io_service *io, unsigned short port, office *database, communications *serial,
+               size_t max_connections = MAX_CONNECTIONS, int idle_seconds = IDLE_TIMEOUT_SECONDS);
     ~tcp_server();
+    void stop();
 };
 
 #endif
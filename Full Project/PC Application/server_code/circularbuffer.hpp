@@ -2,24 +2,50 @@
 #define CIRCULAR_BUFFER_HPP
 
 #include <iostream>
-#include <mutex>
+#include <atomic>
+#include <type_traits>
+#include <cstring>
 #include <unistd.h>
 #include <memory>
 
 #define DEBUG 1
 
+/*
+ * Single-producer / multi-reader ring buffer.
+ *
+ * The serial reader is the only thread that inserts, so the writer never takes a lock.
+ * Readers use seqlock-style snapshots: each insert first announces the position it is about
+ * to overwrite (t_claimed) and only then publishes it (t_written). A reader copies what it needs
+ * and afterwards checks t_claimed to know whether any of the copied slots were recycled meanwhile.
+ */
 template <class T> // template class in order to support any type of data, e.g. float, int, unit8_t
 class circular_array
 {
+    static_assert(std::is_trivially_copyable<T>::value, "circular_array only holds trivially copyable types");
 
 private: // this things are private
     std::unique_ptr<T[]> t_ring;
     const size_t t_array_size = 0;
-    bool t_is_full = false;
-    bool t_is_empty = true;
-    size_t t_head = 0;
-    size_t t_tail = 0;
-    std::mutex t_mutex;
+    size_t t_head = 0; // next slot to be written - only touched by the writer
+
+    std::atomic<uint64_t> t_claimed{0}; // number of inserts started by the writer
+    std::atomic<uint64_t> t_written{0}; // number of inserts visible to the readers
+    std::atomic<uint64_t> t_start{0};   // first valid position since the last restart
+
+    // first position that can be read, given how many items were written
+    uint64_t first_position(uint64_t written) const
+    {
+        uint64_t start = t_start.load(std::memory_order_acquire);
+        uint64_t oldest = written > t_array_size ? written - t_array_size : 0;
+        return start > oldest ? start : oldest;
+    }
+
+    // true when none of the positions >= first were overwritten since they were read
+    bool still_valid(uint64_t first) const
+    {
+        std::atomic_thread_fence(std::memory_order_acquire);
+        return t_claimed.load(std::memory_order_relaxed) <= first + t_array_size;
+    }
 
 public: // this things are public
     // https://stackoverflow.com/questions/21488744/how-to-defined-constructor-outside-of-template-class
@@ -27,7 +53,7 @@ public: // this things are public
     {
         if (DEBUG)
             std::cout << "It was created a circular array with size: " << t_array_size << std::endl;
-        t_ring = std::unique_ptr<T[]>(new T[t_array_size]);
+        t_ring = std::unique_ptr<T[]>(new T[t_array_size]());
     }
 
     ~circular_array()
@@ -36,72 +62,135 @@ public: // this things are public
             std::cout << "It was deleted a circular array" << std::endl;
     };
 
-    bool is_empty() const { return t_is_empty; }
-    bool is_full() const { return t_is_full; }
-    size_t get_size() const { return (t_is_full ? t_array_size : t_head + 1); };
+    bool is_empty() const { return get_size() == 0; }
+    bool is_full() const { return get_size() == t_array_size; }
+    size_t get_size() const
+    {
+        uint64_t written = t_written.load(std::memory_order_acquire);
+        return (size_t)(written - first_position(written));
+    };
+    size_t get_capacity() const { return t_array_size; }
 
+    /*
+     * Only one thread may insert (the serial reader)
+     */
     void insert_newest(T new_item)
     {
-        std::lock_guard<std::mutex> lock(t_mutex);
+        uint64_t position = t_written.load(std::memory_order_relaxed);
 
-        if (t_is_empty)
-        {
-            t_ring[t_head] = new_item;
-            t_is_empty = false;
-        }
-        else
-        {
-            t_head = (t_head + 1) % t_array_size; // updates head value
+        t_claimed.store(position + 1, std::memory_order_relaxed); // announces the slot is going to be recycled
+        std::atomic_thread_fence(std::memory_order_release);
 
-            t_ring[t_head] = new_item; // adds new value
+        t_ring[t_head] = new_item; // adds new value
+        t_head = (t_head + 1 == t_array_size) ? 0 : t_head + 1;
+
+        t_written.store(position + 1, std::memory_order_release); // publishes the new value
+    }
 
-            if ((t_head == t_tail) && t_is_full)
+    T get_newest() const
+    {
+        for (;;)
+        {
+            uint64_t written = t_written.load(std::memory_order_acquire);
+            if (written == first_position(written))
             {
-                t_tail = (t_tail + 1) % t_array_size;
-            } // only updates tail if the array is full
+                return T();
+            } // empty
 
-            t_is_full = (t_head + 1 - t_tail) % t_array_size == 0; // checks if is now full
+            uint64_t newest = written - 1;
+            T item = t_ring[newest % t_array_size];
+
+            if (still_valid(newest))
+            {
+                return item;
+            }
         }
     }
 
-    T get_newest()
+    /*
+     * Zero-copy view of the ring: the two contiguous segments (oldest..end of the array, begin..newest).
+     * It points straight into the ring, so once the values are used the view must be checked with overwritten().
+     */
+    struct view
     {
-        std::lock_guard<std::mutex> lock(t_mutex);
+        const T *first = nullptr;
+        size_t first_size = 0;
+        const T *second = nullptr;
+        size_t second_size = 0;
+        uint64_t position = 0; // position of first[0] since the array was created - works as the view epoch
 
-        if (is_empty())
-        {
-            return T();
-        } // empty
+        size_t size() const { return first_size + second_size; }
+    };
 
-        return t_ring[t_head];
+    view get_view() const
+    {
+        view v;
+        uint64_t written = t_written.load(std::memory_order_acquire);
+        v.position = first_position(written);
+
+        size_t n = (size_t)(written - v.position);
+        size_t begin = (size_t)(v.position % t_array_size);
+
+        v.first = &t_ring[begin];
+        v.first_size = (begin + n > t_array_size) ? t_array_size - begin : n;
+        v.second = &t_ring[0];
+        v.second_size = n - v.first_size;
+        return v;
     }
 
-    std::unique_ptr<T[]> get_all()
+    /*
+     * Returns how many items, counting from the oldest one of the view, were recycled by the writer after the view was taken.
+     * 0 means every value read through the view is consistent.
+     */
+    size_t overwritten(const view &v) const
     {
-        std::lock_guard<std::mutex> lock(t_mutex);
-
-        std::unique_ptr<T[]> ring_out = std::unique_ptr<T[]>(new T[t_array_size]);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        uint64_t claimed = t_claimed.load(std::memory_order_relaxed);
+        if (claimed <= v.position + t_array_size)
+        {
+            return 0;
+        }
+        uint64_t lost = claimed - (v.position + t_array_size);
+        return lost > v.size() ? v.size() : (size_t)lost;
+    }
 
-        for (int i = 0; i < (int)t_array_size; i++)
+    /*
+     * Copies the whole ring, from the oldest to the newest value, into ring_out (t_array_size items) with at most two memcpy's.
+     * Slots that were not written yet are filled with T().
+     * Returns the number of valid items.
+     */
+    size_t copy_all(T *ring_out) const
+    {
+        for (;;)
         {
-            ring_out[i] = t_ring[(i + t_tail) % t_array_size];
+            view v = get_view();
+            std::memcpy(ring_out, v.first, v.first_size * sizeof(T));
+            std::memcpy(ring_out + v.first_size, v.second, v.second_size * sizeof(T));
+
+            if (!overwritten(v))
+            {
+                for (size_t i = v.size(); i < t_array_size; i++)
+                {
+                    ring_out[i] = T();
+                }
+                return v.size();
+            }
         }
+    }
 
+    std::unique_ptr<T[]> get_all() const
+    {
+        std::unique_ptr<T[]> ring_out = std::unique_ptr<T[]>(new T[t_array_size]);
+        copy_all(ring_out.get());
         return ring_out;
     }
 
+    /*
+     * Only the writer may restart: readers simply stop seeing anything older than this point
+     */
     void restart()
     {
-        std::lock_guard<std::mutex> lock(t_mutex);
-
-        for (int i = 0; i < (int)t_array_size; i++)
-        {
-            t_ring[i] = 0;
-        }
-        t_is_full = false;
-        t_is_empty = true;
-        t_head = 0;
-        t_tail = 0;
+        t_start.store(t_written.load(std::memory_order_relaxed), std::memory_order_release);
     }
 };
 
@@ -1,16 +1,31 @@
 #include "database.hpp"
 
-office::office(uint8_t num_lamps) : t_num_lamps(num_lamps)
+#include <thread>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <new>
+
+office::office(uint8_t num_lamps, const office_settings &settings) : t_num_lamps(num_lamps),
+                                                                     t_settings(settings),
+                                                                     t_history(MAX_DESKS, settings.history_blocks)
 {
+    // 1 to one publication per sample period
+    int sample_hz = std::max(settings.sample_hz(), 1);
+    t_publish_ticks = sample_hz / std::min(std::max(settings.publish_hz, 1), sample_hz);
+
     if (DEBUG)
         std::cout << "Welcome to the Office!: " << this << std::endl; // greeting
 
-    t_lamps_array = new lamp *[t_num_lamps]; // creats an array of lamps and return he array of poiters to lamps
-
-    for (int l = 0; l < t_num_lamps; l++) // for each lamp will create one struct
+    // room for every address at once, so a restart never moves a desk
+    void *block = nullptr;
+    if (posix_memalign(&block, CACHE_LINE_BYTES, MAX_DESKS * sizeof(lamp)) != 0)
     {
-        t_lamps_array[l] = new lamp{l + 1}; // stores the address of the new lamp in the array of pointers to lamp object
+        throw std::bad_alloc();
     }
+    t_desks = static_cast<lamp *>(block);
+
+    build_desks(t_num_lamps);
 }
 
 office::~office()
@@ -18,11 +33,33 @@ office::~office()
     std::lock_guard<std::mutex> lock(t_mutex);
     if (DEBUG)
         std::cout << "\nExits the office, see you later aligator! " << this << std::endl; // goodbye message
-    for (int l = 0; l < t_num_lamps; l++)
+    for (int l = 0; l < t_desks_built; l++)
     {
-        delete t_lamps_array[l];
-    }                       // free the memory of each lamp
-    delete[] t_lamps_array; // free the memory of the array of teh lamps' address
+        t_desks[l].~lamp();
+    }              // free the memory of each lamp
+    free(t_desks); // free the block of the desks
+}
+
+/*
+*   Handler of each opcode of the hub, nullptr when the opcode is unknown
+*/
+const office::frame_handler *office::frame_handlers()
+{
+    static frame_handler handlers[256] = {};
+    static bool initialized = [] {
+        handlers[(uint8_t)'A'] = &office::ingest_restart;
+        handlers[(uint8_t)'t'] = &office::ingest_time;
+        handlers[(uint8_t)'o'] = &office::ingest_occupancy;
+        handlers[(uint8_t)'O'] = &office::ingest_occupied_bound;
+        handlers[(uint8_t)'U'] = &office::ingest_unoccupied_bound;
+        handlers[(uint8_t)'s'] = &office::ingest_sample;
+        handlers[(uint8_t)'c'] = &office::ingest_cost;
+        handlers[(uint8_t)'x'] = &office::ingest_reading;
+        handlers[(uint8_t)'r'] = &office::ingest_reading;
+        return true;
+    }();
+    (void)initialized;
+    return handlers;
 }
 
 /*
@@ -30,182 +67,267 @@ office::~office()
 */
 void office::updates_database(char command[], uint8_t size)
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
+    ingest_frame(command, size);
+    end_batch();
+}
 
-    float value = 0.0;
-    //static bool first = true;
+/*
+*   Writes the frames of one read of the serial port, in order: the totals and the UDP datagrams are published
+*   once, at the end of the batch
+*/
+void office::updates_database_batch(hub_frame frames[], size_t n_frames)
+{
+    for (size_t i = 0; i < n_frames; i++)
+    {
+        ingest_frame(frames[i].bytes, frames[i].size);
+    }
+    end_batch();
+}
+
+void office::ingest_frame(char command[], uint8_t size)
+{
+    t_frames.store(t_frames.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // only the serial reader writes
 
+    float value = 0.0;
     char type = command[0];
     int address = (int)(uint8_t)command[1]; // make sure it converts well
-    int set_command = 0;                    // commands that are set by the client
-    //bool error = (int)(uint8_t)( 0x0F & command[3]) == 15;
-    bool error = (0x8 & command[2]);
 
     // prevent sge fault from arduino
-    if( address < 1 || address > t_num_lamps ){ return; }
+    if( address < 1 || (address > t_num_lamps && type != 'A') ){ return; } // a restart carries the new number of lamps
 
-    switch (type)
+    frame_handler handler = frame_handlers()[(uint8_t)type];
+    if (!handler)
     {
-    case 'A': // restart
+        std::cout << "Default at switch " << address << std::endl;
+        return;
+    }
+
+    int set_command = (this->*handler)(command, address, value); // commands that are set by the client
+
+    if (set_command != 0) // happens when the arduino return same value that was set by the client
     {
-        set_command = -1;
-        if (command[2] == ':' && command[3] == ')')
+        if (t_pending.resolve(type, address, std::lround(value * 10), set_command, true))
         {
-            restart_it_all(address); // constains the number of lamps
-            address = 0;
-            value = 0;
-            set_command = 1;
+            if (DEBUG)
+                std::cout << "Pop command ack/err " << set_command << std::endl;
         }
-
-        break;
     }
-    case 't': //  get elapsed time since last restart
+}
+
+/*
+*   Publishes what the frames of the batch changed
+*/
+void office::end_batch()
+{
+    add_to_totals(t_batch_change);
+    t_batch_change = performance_metrics();
+
+    if (t_columns_dirty)
     {
-        t_time_since_last_restart = (float)(address << 12) + bytes_2_float(command[2], command[3]);
-        if (DEBUG)
-            std::cout << "Time since last restart: " << t_time_since_last_restart << " segundos.\n";
-        break;
+        t_columns_version.fetch_add(1, std::memory_order_release); // even: the columns are consistent again
+        t_columns_dirty = false;
     }
-    case 'o': // set current occupancy state at desk <i> - send this before case 'O' during the arduino setup because it will use one of its initial values as checkpoint
-    {
-        value = bytes_2_float(command[2], command[3]);
-        if (error) //(int)value*100
-        {
-            value = value - 0x80; // subtracting the error
-            set_command = -1;
-            break;
-        }
-        else if (t_lamps_array[address - 1]->get_occupied_value() != -1.0) // not to print in the first time
-        {
-            set_command = 1;
-        }
-        // Updates the value in the dataset
-        t_lamps_array[address - 1]->set_state((bool)(int)value);
 
-        if (DEBUG)
-            std::cout << "Desk[" << address << "]\tThe state was step to: " << (t_lamps_array[address - 1]->get_state() ? "occupied" : "unoccupied") << "\n";
-        break;
-    }
-    case 'O': // set lower bound on illuminance for Occupied state at desk <i>
+    if (t_changed && t_ticks - t_published_tick >= t_publish_ticks)
     {
-        value = bytes_2_float(command[2], command[3]);
-        if (error)
-        {
-            value = value - 0x80; // subtracting the error
-            set_command = -1;
-            break;
-        }
-        else if (t_lamps_array[address - 1]->get_occupied_value() != -1.0)
-        {
-            set_command = 1;
-        }
-        // Updates the value in the dataset
-        t_lamps_array[address - 1]->set_occupied_value(value);
+        publish_changes();
+    }
 
-        if (DEBUG)
-            std::cout << "Desk[" << address << "]\tThe occupied value is " << t_lamps_array[address - 1]->get_occupied_value() << "\n";
-        break;
+    flush_udp();
+}
+
+/*
+ * Hands the changes of the followed values to their subscribers, at most PUBLISH_HZ times per second of samples
+ */
+void office::publish_changes()
+{
+    t_changed = false;
+    t_published_tick = t_ticks;
+
+    std::shared_ptr<const std::vector<metric_subscriber *>> subscribers = t_subscriptions.subscribers();
+    if (!subscribers)
+    {
+        return;
     }
-    case 'U': // set lower bound on illuminance for Unoccupied state at desk <i>
+    performance_metrics totals;
+    totals.energy = get_accumulated_energy_consumption();
+    totals.power = get_instant_power();
+    totals.visibility = get_accumulated_visibility_error();
+    totals.flicker = get_accumulated_flicker_error();
+    for (size_t i = 0; i < subscribers->size(); i++)
     {
-        value = bytes_2_float(command[2], command[3]);
-        if (error)
-        {
-            value = value - 0x80; // subtracting the error
-            set_command = -1;
-            break;
-        }
-        else if (t_lamps_array[address - 1]->get_unoccupied_value() != -2.0)
-        {
-            set_command = 1;
-        }
-        // Updates the value in the dataset
-        t_lamps_array[address - 1]->set_unoccupied_value(value);
-
-        if (DEBUG)
-            std::cout << "Desk[" << address << "]\tThe unoccupied value is " << t_lamps_array[address - 1]->get_unoccupied_value() << "\n";
-        break;
+        (*subscribers)[i]->publish(t_columns, totals);
     }
-    case 's': // stop stream of real-time variable <x> of desk <i>; NOTE: <x> can be 'l' or 'd'
+}
+
+/*
+ * The columns, once the readers know they are being changed - until the end of the batch
+ */
+desk_columns &office::write_columns()
+{
+    if (!t_columns_dirty)
     {
-        set_command = false;
-        float luminance = bytes_2_float(command[2], command[3]);
-        t_lamps_array[address - 1]->t_luminance.insert_newest(luminance);
+        t_columns_version.fetch_add(1, std::memory_order_relaxed); // odd
+        std::atomic_thread_fence(std::memory_order_release);
+        t_columns_dirty = true;
+    }
+    t_changed = true;
+    return t_columns;
+}
 
-        float duty_cicle = bytes_2_float(command[4], command[5]) / 100.0;
-        t_lamps_array[address - 1]->t_duty_cicle.insert_newest(duty_cicle);
+/*
+*   Reads the value of a setting echoed by the hub
+*   returns -1 when the hub refused it, 1 when it answers a client, or 0 for the values sent on the setup of the hub
+*/
+int office::read_setting(char command[], float &value, bool initialized) const
+{
+    value = bytes_2_float(command[2], command[3]);
+    if (0x8 & command[2]) // error
+    {
+        value = value - 0x80; // subtracting the error
+        return -1;
+    }
+    return initialized ? 1 : 0;
+}
 
-        t_lamps_array[address - 1]->compute_performance_metrics_at_desk(luminance, duty_cicle);
+int office::ingest_restart(char command[], int &address, float &value)
+{
+    if (command[2] == ':' && command[3] == ')')
+    {
+        restart_it_all(address); // constains the number of lamps
+        t_batch_change = performance_metrics(); // the totals start again
+        address = 0;
+        value = 0;
+        return 1;
+    }
+    return -1;
+}
 
-        // updates time since last system restart when the information about the first one is recived
-        if ((address - 1) == 0)
-        {
-            t_time_since_last_restart += SAMPLE_TIME_MILIS * std::pow(10, -3);
-        }
+int office::ingest_time(char command[], int &address, float &value) //  get elapsed time since last restart
+{
+    t_time_since_last_restart = (float)(address << 12) + bytes_2_float(command[2], command[3]);
+    if (DEBUG)
+        std::cout << "Time since last restart: " << t_time_since_last_restart << " segundos.\n";
+    return 0;
+}
 
-        // streams
-        udp_stream(address);
+// set current occupancy state at desk <i> - send this before case 'O' during the arduino setup because it will use one of its initial values as checkpoint
+int office::ingest_occupancy(char command[], int &address, float &value)
+{
+    lamp *desk = &t_desks[address - 1];
+    int set_command = read_setting(command, value, desk->get_occupied_value() != -1.0); // not to print in the first time
+    if (set_command != -1)
+    {
+        desk->set_state((bool)(int)value);
+        write_columns().state[address - 1] = desk->get_state();
+        if (DEBUG)
+            std::cout << "Desk[" << address << "]\tThe state was step to: " << (desk->get_state() ? "occupied" : "unoccupied") << "\n";
+    }
+    return set_command;
+}
 
-        break;
+int office::ingest_occupied_bound(char command[], int &address, float &value) // set lower bound on illuminance for Occupied state at desk <i>
+{
+    lamp *desk = &t_desks[address - 1];
+    int set_command = read_setting(command, value, desk->get_occupied_value() != -1.0);
+    if (set_command != -1)
+    {
+        desk->set_occupied_value(value);
+        write_columns().occupied[address - 1] = value;
+        if (DEBUG)
+            std::cout << "Desk[" << address << "]\tThe occupied value is " << desk->get_occupied_value() << "\n";
     }
-    case 'c': // set current energy cost at desk <x>
+    return set_command;
+}
+
+int office::ingest_unoccupied_bound(char command[], int &address, float &value) // set lower bound on illuminance for Unoccupied state at desk <i>
+{
+    lamp *desk = &t_desks[address - 1];
+    int set_command = read_setting(command, value, desk->get_unoccupied_value() != -2.0);
+    if (set_command != -1)
     {
-        value = bytes_2_float(command[2], command[3]);
-        if (error)
-        {
-            value = value - 0x80; // subtracting the error
-            set_command = -1;
-            break;
-        }
-        else if (t_lamps_array[address - 1]->get_nominal_power() != -1.0)
-        {
-            set_command = 1;
-        }
-        // Updates the value in the dataset
-        t_lamps_array[address - 1]->set_nominal_power(value);
+        desk->set_unoccupied_value(value);
+        write_columns().unoccupied[address - 1] = value;
+        if (DEBUG)
+            std::cout << "Desk[" << address << "]\tThe unoccupied value is " << desk->get_unoccupied_value() << "\n";
+    }
+    return set_command;
+}
 
+int office::ingest_cost(char command[], int &address, float &value) // set current energy cost at desk <x>
+{
+    lamp *desk = &t_desks[address - 1];
+    int set_command = read_setting(command, value, desk->get_nominal_power() != -1.0);
+    if (set_command != -1)
+    {
+        desk->set_nominal_power(value);
+        write_columns().cost[address - 1] = value;
         if (DEBUG)
-            std::cout << "Desk[" << address << "]\tThe cost value is " << t_lamps_array[address - 1]->get_nominal_power() << "\n";
-        break;
+            std::cout << "Desk[" << address << "]\tThe cost value is " << desk->get_nominal_power() << "\n";
     }
-    case 'x':
-    case 'r':
+    return set_command;
+}
+
+int office::ingest_sample(char command[], int &address, float &value) // real-time luminance and duty cycle of desk <i>
+{
+    lamp *desk = &t_desks[address - 1];
+
+    float luminance = bytes_2_float(command[2], command[3]);
+    desk->t_luminance.insert_newest(luminance);
+
+    float duty_cicle = bytes_2_float(command[4], command[5]) / 100.0;
+    desk->t_duty_cicle.insert_newest(duty_cicle);
+
+    performance_metrics change = desk->compute_performance_metrics_at_desk(luminance, duty_cicle);
+
+    desk_columns &columns = write_columns();
+    columns.energy[address - 1] = desk->get_accumulated_energy_consumption_at_desk();
+    columns.power[address - 1] = desk->get_instant_power_at_desk();
+    columns.visibility[address - 1] = desk->get_accumulated_visibility_error_at_desk();
+    columns.flicker[address - 1] = desk->get_accumulated_flicker_error_at_desk();
+    columns.luminance[address - 1] = luminance;
+    columns.duty_cicle[address - 1] = duty_cicle;
+    t_batch_change.energy += change.energy;
+    t_batch_change.power += change.power;
+    t_batch_change.visibility += change.visibility;
+    t_batch_change.flicker += change.flicker;
+
+    // updates time since last system restart when the information about the first one is recived
+    if ((address - 1) == 0)
     {
-        set_command = 0; // speacial case
-        std::string client_msg = std::string(1, type) + std::to_string(address);
-        std::vector<int>::size_type sz = t_clients_address.size();
-        value = bytes_2_float(command[2], command[3]);
+        t_time_since_last_restart = t_time_since_last_restart + t_settings.sample_ms * std::pow(10, -3); // only the ingest writes it
+        t_ticks++;
 
-        for (unsigned int i = 0; i < sz; i++)
+        std::shared_ptr<const binary_list> subscribers = t_streams.binary_subscribers();
+        if (subscribers && t_ticks % STREAM_FLUSH_TICKS == 0) // binary streams are sent in batches
         {
-            if (!t_clients_command.at(i).compare(client_msg)) // return status
+            for (size_t i = 0; i < subscribers->size(); i++)
             {
-                std::cout << "Pop command value " << set_command << std::endl;
-                t_acknowledge.at(i) = 10 * value;
+                send_binary_datagram(*(*subscribers)[i]);
             }
         }
-        break;
-    }
-    default:
-        std::cout << "Default at switch " << address << std::endl;
-        break;
     }
 
-    if (set_command != 0) // happens when the arduino return same value that was set by the client
-    {
-        int int_value = value * 10;
-        std::string client_msg = std::string(1, type) + std::to_string(address) + std::to_string(int_value);
+    // long term history
+    t_history.append(address, 'l', t_ticks, luminance);
+    t_history.append(address, 'd', t_ticks, duty_cicle);
 
-        std::vector<int>::size_type sz = t_clients_address.size();
-        for (unsigned int clt = 0; clt < sz; clt++)
-        {
-            if (!t_clients_command.at(clt).compare(client_msg)) // return status
-            {
-                std::cout << "Pop command ack/err " << set_command << std::endl;
-                t_acknowledge.at(clt) = set_command;
-            }
-        }
+    // streams
+    udp_stream(address, luminance, duty_cicle);
+
+    return 0;
+}
+
+int office::ingest_reading(char command[], int &address, float &value) // answer to a get command sent to the hub
+{
+    value = bytes_2_float(command[2], command[3]);
+
+    if (t_pending.resolve(command[0], address, 0, std::lround(10 * value), false))
+    {
+        if (DEBUG)
+            std::cout << "Pop command value " << value << std::endl;
     }
+    return 0; // speacial case
 }
 
 /*
@@ -213,215 +335,355 @@ void office::updates_database(char command[], uint8_t size)
 */
 float office::bytes_2_float(uint8_t most_significative_bit, uint8_t less_significative_bit) const
 {
-    float decimal_number = less_significative_bit & 0xF;                                           // gets 4 less significatives bits
-    float integer_number = (most_significative_bit << 4) + ((less_significative_bit & 0xF0) >> 4); // gets 12 most significatives bits
+    uint16_t raw = fixed_12_4_from_bytes(most_significative_bit, less_significative_bit);
 
-    if (decimal_number == 15.0) // invalid read detected
-    {
-        if (DEBUG)
-            std::cout << "INVALID NUMBER - number must be positive\t";
-        return decimal_number * 0.01;
-    }
+    if (DEBUG && fixed_12_4_is_invalid(raw)) // invalid read detected
+        std::cout << "INVALID NUMBER - number must be positive\t";
 
-    // std::cout << "integer " << integer_number << " decimal " <<decimal_number << std::endl;
-    return integer_number + decimal_number * 0.1;
+    return fixed_12_4_decode(raw);
 }
 
 /*
- * This function is used to represent a float number in 2 bytes.
+ * This function is used to represent a float number in 2 bytes (see fixed_point.hpp).
  * 
  * The 12 most significatives bits represents the integer part with resolution 0:4095
  * The 4  less significatives bits represents the decimal part with resolution 0:9
- * 
- * Sends '*' when there is nothing to be said, which corresnponds to 10 in the 4 less significative bits
  */
 void office::float_2_bytes(float fnum, u_int8_t bytes[2]) const
 {
-    // the maxium admissive value is 4095.94(9)
-    fnum = fnum < pow(2, 12) - 0.05 ? fnum : pow(2, 12) - 1 + 0.9; // 2^12-1 == 4095, 12 bits representation + 4bits to decimal representation(0.1 -> 0.9)
+    uint16_t output = fixed_12_4_encode(fnum);
 
-    uint16_t output = fnum < 0;      // flag that represents if fnum is negative
-    uint16_t inum = fnum;            // integer part
-    fnum = fnum - inum;              // floating part
-    uint8_t dnum = round(10 * fnum); // integer decimal part
+    bytes[1] = (uint8_t)(output >> 8); // wirte second byte - DEBUG: Serial.println((byte) (output>>8))
+    bytes[0] = (uint8_t)output;        // write first byte - DEBUG: Serial.println((byte) output);
+}
 
-    // increments one when the decimal part rounds up
-    if (dnum == 10)
-    {
-        dnum = 0;
-        inum++;
-    }
+/*
+ * Adds the change of the metrics of one desk to the metrics of the whole system - only the ingest calls it
+ */
+void office::add_to_totals(const performance_metrics &change)
+{
+    t_total_energy.store(t_total_energy.load(std::memory_order_relaxed) + change.energy, std::memory_order_relaxed);
+    t_total_power.store(t_total_power.load(std::memory_order_relaxed) + change.power, std::memory_order_relaxed);
+    t_total_visibility.store(t_total_visibility.load(std::memory_order_relaxed) + change.visibility, std::memory_order_relaxed);
+    t_total_flicker.store(t_total_flicker.load(std::memory_order_relaxed) + change.flicker, std::memory_order_relaxed);
+}
 
-    inum = inum << 4;                   // the integer will be represent in the first 1,5 bits
-    output = output ? 15 : inum + dnum; // send 15 when fnum is negative, which should not be possible
+/*
+ * Socket used by the streams - it is set once, before any stream starts
+ */
+void office::set_udp_socket(boost::asio::ip::udp::socket *socket, boost::asio::io_context::strand *strand)
+{
+    t_socket = socket;
+    t_udp_strand = strand;
+}
 
-    bytes[1] = (uint8_t)(output >> 8); // wirte second byte - DEBUG: Serial.println((byte) (output>>8))
-    bytes[0] = (uint8_t)output;        // write first byte - DEBUG: Serial.println((byte) output);
+/*
+ * Controls stream parameters
+ * return whereas the stream has started 0, if it was stopped correctly 1 or not wrong command -1
+ */
+int office::set_upd_stream(char type, int address, boost::asio::ip::udp::endpoint endpoint)
+{
+    return t_streams.toggle_text(type, address, endpoint);
 }
 
 /*
- * Computes the total accumulated energy since last system restart
+ * Starts or stops the binary stream of variable <type> of desk <address> to the client
+ * return whereas the stream has started 0, if it was stopped correctly 1 or wrong command -1
  */
-float office::get_accumulated_energy_consumption()
+int office::set_binary_stream(char type, int address, boost::asio::ip::udp::endpoint endpoint)
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
+    return t_streams.toggle_binary(type, address, endpoint);
+}
+
+/*
+ * Queues a datagram for the end of the batch; owner keeps the data alive until the send completes
+ */
+void office::send_udp(std::shared_ptr<const void> owner, const char *data, size_t size, const boost::asio::ip::udp::endpoint &endpoint)
+{
+    t_outbox.push_back(udp_datagram{owner, data, size, endpoint});
+}
 
-    float energy = 0.0;
-    for (int i = 0; i < t_num_lamps; i++)
+/*
+ * Sends every datagram queued by the batch, with a single post to the strand of the UDP server
+ */
+void office::flush_udp()
+{
+    if (t_outbox.empty())
     {
-        energy += t_lamps_array[i]->get_accumulated_energy_consumption_at_desk();
+        return;
     }
-    return energy;
+
+    std::shared_ptr<std::vector<udp_datagram>> outbox = std::make_shared<std::vector<udp_datagram>>();
+    outbox->swap(t_outbox);
+    t_outbox.reserve(outbox->size());
+
+    boost::asio::ip::udp::socket *socket = t_socket;
+    boost::asio::post(*t_udp_strand, [socket, outbox]() {
+        for (size_t i = 0; i < outbox->size(); i++)
+        {
+            const udp_datagram &datagram = (*outbox)[i];
+            socket->async_send_to(boost::asio::buffer(datagram.data, datagram.size), datagram.endpoint,
+                                  [outbox](const boost::system::error_code &t_ec, std::size_t len) {
+                                      // Nice Job :)
+                                  });
+        }
+    });
 }
 
 /*
- * Computes the instataneous total power consumption in the system
+ * Sends real time data to the UDP clients of desk <address>: text streams right away, binary streams packed in datagrams
  */
-float office::get_instant_power()
+void office::udp_stream(int address, float luminance, float duty_cicle)
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
+    std::shared_ptr<const desk_streams> streams = t_streams.desk(address);
+    if (!streams)
+    {
+        return;
+    } // nobody follows this desk
+
+    for (size_t i = 0; i < streams->text.size(); i++)
+    {
+        char type = streams->text[i].second;
+        float value = type == 'l' ? luminance : duty_cicle;
+        std::string str_value = std::to_string(value);
+        std::string str_time = std::to_string(t_time_since_last_restart);
 
-    float power = 0.0;
-    for (int i = 0; i < t_num_lamps; i++)
+        std::shared_ptr<std::string> response = std::make_shared<std::string>(std::string(1, 's') + '\t' + std::string(1, type) + '\t' + std::to_string(address) + '\t' + str_value.erase(str_value.size() - 5) + '\t' + str_time.erase(str_time.size() - 4));
+
+        send_udp(response, response->data(), response->size(), streams->text[i].first);
+    }
+
+    for (size_t i = 0; i < streams->binary.size(); i++)
     {
-        power += t_lamps_array[i]->get_instant_power_at_desk();
+        binary_subscriber &subscriber = *streams->binary[i].first;
+        char type = streams->binary[i].second;
+
+        subscriber.pending->append(stream_sample{(uint8_t)address, type, type == 'l' ? luminance : duty_cicle, t_ticks});
+        if (subscriber.pending->is_full())
+        {
+            send_binary_datagram(subscriber);
+        }
     }
-    return power;
 }
 
 /*
- * Computes the total accumulated visibility error since last system restart
+ * Sends the datagram being filled, if it has samples, and starts the next one
  */
-float office::get_accumulated_visibility_error()
+void office::send_binary_datagram(binary_subscriber &subscriber)
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
-
-    float visibility = 0.0;
-    for (int i = 0; i < t_num_lamps; i++)
+    if (subscriber.pending->is_empty())
     {
-        visibility += t_lamps_array[i]->get_accumulated_visibility_error_at_desk();
+        return;
     }
-    return visibility;
+
+    std::shared_ptr<stream_datagram> datagram = subscriber.pending; // alive until the send completes
+    send_udp(datagram, datagram->bytes, datagram->size, subscriber.endpoint);
+
+    subscriber.pending = std::make_shared<stream_datagram>();
+    subscriber.pending->begin(STREAM_KIND_SAMPLES, ++subscriber.sequence);
 }
 
 /*
- * Computes the total accumulated flicker error since last system restart
+ * Reads the values of variable <x> of desk <i> in the last <seconds> from the compressed history.
+ * <seconds> comes straight from a client: it is clamped to [0, everything kept], and nothing is read when it is not a number
  */
-float office::get_accumulated_flicker_error()
+size_t office::get_history(char type, int address, float seconds, std::vector<float> &values) const
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
-
-    float flicker = 0.0;
-    for (int i = 0; i < t_num_lamps; i++)
+    if (!std::isfinite(seconds))
     {
-        flicker += t_lamps_array[i]->get_accumulated_flicker_error_at_desk();
+        return 0;
     }
-    return flicker;
+
+    uint32_t now = t_ticks;
+    double span = std::ceil(std::max(seconds, 0.0f) * 1000.0 / t_settings.sample_ms); // in ticks, compared before the cast
+    uint32_t from = span < now ? now - (uint32_t)span : 0;
+
+    return t_history.query(address, type, from, now, values);
 }
 
 /*
- * Controls stream parameters
- * return whereas the stream has started 0, if it was stopped correctly 1 or not wrong command -1
+ * Metrics of desk <i>, or of the whole system when <i> is 0, over the last <seconds>:
+ * energy and flicker accumulated in the window, mean power and mean visibility error of its samples
  */
-int office::set_upd_stream(char type, int address, boost::asio::ip::udp::socket *socket, boost::asio::ip::udp::endpoint endpoint)
+performance_metrics office::get_window_metrics(int address, float seconds) const
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
-
-    // finds if the is already streaming
-    std::vector<int>::size_type sz = t_udp_endpoints.size();
-    for (int i = sz - 1; i >= 0; i--)
+    for (;;)
     {
-        if ((t_udp_endpoints.at(i) == endpoint)) // stream is happening for this client
+        uint32_t epoch = get_epoch();
+        if (epoch & 1) // a restart is resetting the desks
         {
-            if ((t_udp_stream_type.at(i) == type) && (t_udp_stream_address.at(i) == address))
+            std::this_thread::yield();
+            continue;
+        }
+
+        performance_metrics metrics;
+        int first = address == 0 ? 1 : address;
+        int last = address == 0 ? t_num_lamps.load() : address;
+
+        for (int i = first; i <= last; i++)
+        {
+            window_sums sums = t_desks[i - 1].get_window_at_desk(seconds);
+            metrics.energy += sums.energy;
+            metrics.flicker += sums.flicker;
+            if (sums.samples)
             {
-                t_udp_endpoints.erase( t_udp_endpoints.begin() + i );
-                t_udp_stream_type.erase( t_udp_stream_type.begin() + i );
-                t_udp_stream_address.erase( t_udp_stream_address.begin() + i );
-                return 1; // stoped stream successfully
-            }
-            else
-            {   
-                return -1; // stream is happening
+                metrics.power += sums.power / sums.samples;
+                metrics.visibility += sums.visibility / sums.samples;
             }
         }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t_epoch.load(std::memory_order_relaxed) == epoch)
+        {
+            return metrics;
+        }
     }
+}
 
-    t_udp_endpoints.push_back(endpoint);
-    t_udp_stream_type.push_back(type);
-    t_udp_stream_address.push_back(address); 
+desk_columns::desk_columns()
+{
+    std::fill(cost, cost + MAX_DESKS, -1.0f);
+    std::fill(occupied, occupied + MAX_DESKS, -1.0f);
+    std::fill(unoccupied, unoccupied + MAX_DESKS, -2.0f);
+}
 
-    // updates data and starts stream;
-    t_socket = socket;
-    return 0;
+const float *desk_columns::column(char type) const
+{
+    switch (type)
+    {
+    case 'e':
+        return energy;
+    case 'p':
+        return power;
+    case 'v':
+        return visibility;
+    case 'f':
+        return flicker;
+    case 'c':
+        return cost;
+    case 'd':
+        return duty_cicle;
+    case 'l':
+        return luminance;
+    case 'O':
+        return occupied;
+    case 'U':
+        return unoccupied;
+    case 'o':
+        return state;
+    default:
+        return nullptr;
+    }
 }
+
 /*
- * Sends real time data to UDP client
+ * Copies value <type> (one of DESK_COLUMNS) of every desk into values, as of the end of the last batch
+ * returns the number of desks, 0 when <type> is not one of them
  */
-void office::udp_stream( int address )
+size_t office::get_all_desks(char type, float values[MAX_DESKS]) const
 {
+    const float *column = t_columns.column(type);
+    if (!column)
+    {
+        return 0;
+    }
 
-    // checks if a streamings is happening
-    char type;
-    float value;
-    std::vector<int>::size_type sz = t_udp_endpoints.size();
-    for (int i = sz - 1; i >= 0; i--)
+    for (;;)
     {
-        if ( t_udp_stream_address.at(i) == address )
-        {   
-            type = t_udp_stream_type.at(i);
-            value = type == 'l' ? t_lamps_array[address-1]->t_luminance.get_newest() : t_lamps_array[address-1]->t_duty_cicle.get_newest();
-            std::string str_value = std::to_string(value);
-            std::string str_time = std::to_string(t_time_since_last_restart);
+        uint32_t version = t_columns_version.load(std::memory_order_acquire);
+        if (version & 1) // a batch is changing them
+        {
+            std::this_thread::yield();
+            continue;
+        }
 
-            std::string response = std::string(1, 's') + '\t' + std::string(1, type) + '\t' + std::to_string(address) + '\t' + str_value.erase(str_value.size() - 5) + '\t' + str_time.erase(str_time.size() - 4);
+        size_t n_desks = std::min(std::max(t_num_lamps.load(), 0), MAX_DESKS);
+        std::memcpy(values, column, n_desks * sizeof(float));
 
-            t_socket->async_send_to(boost::asio::buffer(response.c_str(), response.size()), (t_udp_endpoints.at(i)),
-                                    [response](const boost::system::error_code &t_ec, std::size_t len) {
-                                        //std::cout << response << std::endl;
-                                        // Nice Job :)
-                                    });
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t_columns_version.load(std::memory_order_relaxed) == version)
+        {
+            return n_desks;
         }
     }
 }
 
-int office::get_num_lamps()
+/*
+ * Copies every column of every desk, the totals and the time since the last restart, as of the end of the same batch
+ */
+void office::get_snapshot(office_snapshot &snapshot) const
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_num_lamps;
+    for (;;)
+    {
+        uint32_t epoch = get_epoch();
+        uint32_t version = t_columns_version.load(std::memory_order_acquire);
+        if ((epoch & 1) || (version & 1)) // a restart or a batch is changing them
+        {
+            std::this_thread::yield();
+            continue;
+        }
+
+        snapshot.n_desks = std::min(std::max(t_num_lamps.load(), 0), MAX_DESKS);
+        snapshot.seconds = t_time_since_last_restart.load(std::memory_order_relaxed);
+        snapshot.totals.energy = get_accumulated_energy_consumption();
+        snapshot.totals.power = get_instant_power();
+        snapshot.totals.visibility = get_accumulated_visibility_error();
+        snapshot.totals.flicker = get_accumulated_flicker_error();
+        for (const char *type = DESK_COLUMNS; *type; type++)
+        {
+            std::memcpy(snapshot.desks.column(*type), t_columns.column(*type), snapshot.n_desks * sizeof(float));
+        }
+
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (t_columns_version.load(std::memory_order_relaxed) == version && t_epoch.load(std::memory_order_relaxed) == epoch)
+        {
+            return;
+        }
+    }
 }
 
+/*
+*   Restart of the hub: the desks are reset in their slots, nothing is freed and, unless the hub has more desks than
+*   ever before, nothing is allocated. The readers that look at the whole office check the epoch to retry a query
+*   that crossed the restart
+*/
 void office::restart_it_all(int lamps)
 {
+    std::lock_guard<std::mutex> lock(t_mutex);
+    lamps = std::min(std::max(lamps, 0), MAX_DESKS);
+
+    uint32_t epoch = t_epoch.load(std::memory_order_relaxed);
+    t_epoch.store(epoch + 1, std::memory_order_relaxed); // odd: resetting
+    std::atomic_thread_fence(std::memory_order_release);
 
-    // deletes previous nodes
-    for (int i = 0; i < t_num_lamps; i++)
+    for (int l = 0; l < std::min(lamps, t_desks_built); l++)
     {
-        delete t_lamps_array[i];
+        t_desks[l].reset();
     }
-    delete[] t_lamps_array;
+    build_desks(lamps); // the new addresses
 
     // clears office class (this)
     t_time_since_last_restart = 0.0;
     t_num_lamps = lamps;
+    t_total_energy = 0.0;
+    t_total_power = 0.0;
+    t_total_visibility = 0.0;
+    t_total_flicker = 0.0;
 
-    std::vector<int>::size_type sz = t_clients_address.size();
-    for (int clt = sz - 1; clt >= 0; clt--)
-    {
-        if (t_clients_command.at(clt).compare("A00")) // if message is to restart does not restart
-        {
-            t_clients_address.erase(t_clients_address.begin() + clt);
-            t_clients_command.erase(t_clients_command.begin() + clt);
-            t_acknowledge.erase(t_acknowledge.begin() + clt);
-        }
-    }
+    t_pending.clear_except('A'); // if message is to restart does not restart
+    write_columns() = desk_columns();
 
-    t_lamps_array = new lamp *[t_num_lamps]; // creats an array of lamps and return he array of poiters to lamps
+    t_epoch.store(epoch + 2, std::memory_order_release);
+}
 
-    // creates new nodes
-    for (int l = 0; l < t_num_lamps; l++) // for each lamp will create one struct
+/*
+*   Builds the lamps of the addresses up to <lamps> that were never used
+*/
+void office::build_desks(int lamps)
+{
+    for (; t_desks_built < lamps; t_desks_built++)
     {
-        t_lamps_array[l] = new lamp{l + 1}; // stores the address of the new lamp in the array of pointers to lamp object
+        new (&t_desks[t_desks_built]) lamp{t_desks_built + 1, t_settings};
     }
 }
 
@@ -429,7 +691,11 @@ void office::restart_it_all(int lamps)
    |                                  Lamp                                        |
    -------------------------------------------------------------------------------- */
 
-lamp::lamp(int address) : t_address((uint8_t)address) // stores personal address of CAN BUS
+lamp::lamp(int address, const office_settings &settings) : t_address((uint8_t)address), // stores personal address of CAN BUS
+                                                           t_sample_seconds(settings.sample_ms * 1e-3f),
+                                                           t_window(settings.window_seconds, (uint32_t)settings.sample_hz()),
+                                                           t_luminance(settings.minute_points()),
+                                                           t_duty_cicle(settings.minute_points())
 {
     if (DEBUG)
         std::cout << "I am a lamp at the address " << (int)t_address << " ;)\n"; // greeting
@@ -437,106 +703,98 @@ lamp::lamp(int address) : t_address((uint8_t)address) // stores personal address
 
 lamp::~lamp()
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
     if (DEBUG)
         std::cout << "Ups... seems that one lamp is not available anymore.\n"; // goodbye message
 }
 
 /*
- *  Computes Performence metrcis such as energy, power, flicker, visibility
+ * Back to the state of a new lamp, in place - only the ingest calls it. The readers see either the old or the new
+ * values, and the buffers simply look empty from here on
  */
-void lamp::compute_performance_metrics_at_desk(float new_luminance, float new_duty_cicle)
+void lamp::reset()
 {
-    std::lock_guard<std::mutex> lock(t_mutex);
+    t_accumulated_energy_consumption.store(0.0, std::memory_order_relaxed);
+    t_instant_power.store(0.0, std::memory_order_relaxed);
+    t_accumulated_visibility_error.store(0.0, std::memory_order_relaxed);
+    t_accumulated_flicker_error.store(0.0, std::memory_order_relaxed);
+
+    t_luminance_prev_1 = 0.0;
+    t_luminance_prev_2 = 0.0;
+    t_duty_cicle_prev = 0.0;
+    t_n_samples = 0;
+    t_window.reset();
+
+    t_state = false;
+    t_occupied_value = -1.0;
+    t_unoccupied_value = -2.0;
+    t_nominal_power = -1.0;
+
+    t_luminance.restart();
+    t_duty_cicle.restart();
+}
+
+/*
+ * Minimum, maximum, mean and standard deviation of the last minute of variable <type> ('l' or 'd') of the desk
+ */
+series_stats lamp::get_last_minute_stats(char type) const
+{
+    const circular_array<float> &series = type == 'l' ? t_luminance : t_duty_cicle;
+    for (;;)
+    {
+        circular_array<float>::view v = series.get_view();
+        series_stats stats = stats_of(v.first, v.first_size, v.second, v.second_size); // straight from the ring
+        if (!series.overwritten(v))
+        {
+            return stats;
+        }
+    }
+}
+
+/*
+ *  Computes Performence metrcis such as energy, power, flicker, visibility, and returns how much they changed
+ */
+performance_metrics lamp::compute_performance_metrics_at_desk(float new_luminance, float new_duty_cicle)
+{
+    performance_metrics before;
+    before.energy = t_accumulated_energy_consumption.load(std::memory_order_relaxed);
+    before.power = t_instant_power.load(std::memory_order_relaxed);
+    before.visibility = t_accumulated_visibility_error.load(std::memory_order_relaxed);
+    before.flicker = t_accumulated_flicker_error.load(std::memory_order_relaxed);
+
+    float nominal_power = t_nominal_power;
+
     // Computes Instante Power
-    t_instant_power = t_nominal_power * new_duty_cicle;
+    float instant_power = nominal_power * new_duty_cicle;
 
     // Computes accumulated energy consumption
-    t_accumulated_energy_consumption += t_nominal_power * t_duty_cicle_prev * SAMPLE_TIME_MILIS * std::pow(10, -3);
+    float energy = before.energy + nominal_power * t_duty_cicle_prev * t_sample_seconds;
 
     // Computes accumulated visibility error
     t_n_samples++;
     double Reference = t_state ? t_occupied_value : t_unoccupied_value;
-    t_accumulated_visibility_error = ((t_n_samples - 1) * t_accumulated_visibility_error + std::max(0.0, Reference - new_luminance)) / t_n_samples;
+    double visibility_error = std::max(0.0, Reference - new_luminance);
+    float visibility = ((t_n_samples - 1) * before.visibility + visibility_error) / t_n_samples;
 
     // Computes accumulated flicker error
-    float flicker = (((new_luminance - t_luminance_prev_1) * (t_luminance_prev_1 - t_luminance_prev_2)) < 0) ? (abs(new_luminance - t_luminance_prev_1) + abs(t_luminance_prev_1 - t_luminance_prev_2)) / (2 * SAMPLE_TIME_MILIS * std::pow(10, -3)) : 0;
-    t_accumulated_flicker_error += flicker;
+    float flicker = (((new_luminance - t_luminance_prev_1) * (t_luminance_prev_1 - t_luminance_prev_2)) < 0) ? (std::abs(new_luminance - t_luminance_prev_1) + std::abs(t_luminance_prev_1 - t_luminance_prev_2)) / (2 * t_sample_seconds) : 0;
+    flicker += before.flicker;
 
     // Updates new_values
     t_luminance_prev_2 = t_luminance_prev_1;
     t_luminance_prev_1 = new_luminance;
     t_duty_cicle_prev = new_duty_cicle;
-}
-
-float lamp::get_accumulated_energy_consumption_at_desk()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_accumulated_energy_consumption;
-}
-
-float lamp::get_instant_power_at_desk()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_instant_power;
-}
-
-float lamp::get_accumulated_visibility_error_at_desk()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_accumulated_visibility_error;
-}
 
-float lamp::get_accumulated_flicker_error_at_desk()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_accumulated_flicker_error;
-}
+    t_instant_power.store(instant_power, std::memory_order_relaxed);
+    t_accumulated_energy_consumption.store(energy, std::memory_order_relaxed);
+    t_accumulated_visibility_error.store(visibility, std::memory_order_relaxed);
+    t_accumulated_flicker_error.store(flicker, std::memory_order_relaxed);
 
-void lamp::set_state(bool state)
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    t_state = state;
-}
-
-bool lamp::get_state()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_state;
-}
-
-void lamp::set_occupied_value(float value)
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    t_occupied_value = value;
-}
+    t_window.add(energy - before.energy, instant_power, visibility_error, flicker - before.flicker);
 
-float lamp::get_occupied_value()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_occupied_value;
-}
-
-void lamp::set_unoccupied_value(float value)
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    t_unoccupied_value = value;
-}
-
-float lamp::get_unoccupied_value()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_unoccupied_value;
-}
-
-void lamp::set_nominal_power(float value)
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    t_nominal_power = value;
-}
-
-float lamp::get_nominal_power()
-{
-    std::lock_guard<std::mutex> lock(t_mutex);
-    return t_nominal_power;
+    performance_metrics change;
+    change.energy = energy - before.energy;
+    change.power = instant_power - before.power;
+    change.visibility = visibility - before.visibility;
+    change.flicker = flicker - before.flicker;
+    return change;
 }
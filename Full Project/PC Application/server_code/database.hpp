@@ -3,62 +3,155 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
 #include <algorithm>
+#include <memory>
+#include <atomic>
+#include <mutex>
 
 #include <boost/asio.hpp>
 #include "circularbuffer.hpp"
+#include "timeseries.hpp"
+#include "stream_table.hpp"
+#include "pending_table.hpp"
+#include "subscription_table.hpp"
+#include "frame_parser.hpp"
+#include "window_metrics.hpp"
+#include "fixed_point.hpp"
+#include "simd_kernels.hpp"
 
-#define N_POINTS_MINUTE 6000
-#define SAMPLE_TIME_MILIS 10
+#define N_POINTS_MINUTE 6000 // samples of a desk in the last minute, by default
+#define SAMPLE_TIME_MILIS 10 // sample period of the hub, by default
+#define MAX_DESKS 255 // the address of a desk is sent in one byte
+#define CACHE_LINE_BYTES 64
+#define DESK_COLUMNS "epvfcdlOUo" // the values of each desk kept in the desk_columns, by the letter of their 'g' command
+
+/*
+ * Sizes of the office, chosen when the server starts - the defaults are the ones of the hub of the lab
+ */
+struct office_settings
+{
+    int sample_ms = SAMPLE_TIME_MILIS;         // sample period of the hub
+    size_t history_blocks = HISTORY_MAX_BLOCKS; // compressed blocks kept per (desk, variable)
+    size_t window_seconds = WINDOW_MAX_SECONDS; // longest window of the 'g e/p/v/f <i> <seconds>' queries
+    int publish_hz = PUBLISH_HZ;               // publications of the changes per second, at most
+
+    size_t minute_points() const { return (size_t)(60000 / sample_ms); } // samples of a desk in the last minute
+    int sample_hz() const { return 1000 / sample_ms; }
+};
+
+/*
+ * Performance metrics of a desk or of the whole system
+ */
+struct performance_metrics
+{
+    double energy = 0.0;
+    double power = 0.0;
+    double visibility = 0.0;
+    double flicker = 0.0;
+};
 
 /*
  * Represents the lamp-desk
+ *
+ * Only the ingest (the serial reader) writes a lamp, any thread reads it: the values read by the servers are atomics,
+ * so there is no lock per desk. Each lamp starts on its own cache line, so the ingest writing one desk does not
+ * invalidate the line a server is reading from the next one.
  */
-class lamp
+class alignas(CACHE_LINE_BYTES) lamp
 {
 
 private: // this things are private
     uint8_t t_address = 0;
 
     // performence metrics
-    float t_accumulated_energy_consumption = 0.0;
-    float t_instant_power = 0.0;
-    float t_accumulated_visibility_error = 0.0;
-    float t_accumulated_flicker_error = 0.0;
+    std::atomic<float> t_accumulated_energy_consumption{0.0};
+    std::atomic<float> t_instant_power{0.0};
+    std::atomic<float> t_accumulated_visibility_error{0.0};
+    std::atomic<float> t_accumulated_flicker_error{0.0};
 
+    // only the ingest reads them
     float t_luminance_prev_1 = 0.0;
     float t_luminance_prev_2 = 0.0;
     float t_duty_cicle_prev = 0.0;
-    unsigned short t_n_samples = 0;
-    bool t_state = false; // false - the desk in unoccupied, true - the desk is occupied
-    float t_occupied_value = -1.0;
-    float t_unoccupied_value = -2.0;
-    float t_nominal_power = -1.0;
+    uint32_t t_n_samples = 0;
+    float t_sample_seconds;  // sample period
+    metric_window t_window; // the metrics over the last seconds
 
-    std::mutex t_mutex;
+    std::atomic<bool> t_state{false}; // false - the desk in unoccupied, true - the desk is occupied
+    std::atomic<float> t_occupied_value{-1.0};
+    std::atomic<float> t_unoccupied_value{-2.0};
+    std::atomic<float> t_nominal_power{-1.0};
 
 public: // this things are public
     // variables
 
-    circular_array<float> t_luminance{N_POINTS_MINUTE};
-    circular_array<float> t_duty_cicle{N_POINTS_MINUTE};
+    circular_array<float> t_luminance; // the last minute
+    circular_array<float> t_duty_cicle;
 
     // functions
-    lamp(int address);
+    lamp(int address, const office_settings &settings = office_settings());
     ~lamp(); // https://stackoverflow.com/questions/7850374/stuck-in-infinite-loop-in-deallocating-memory
-    float get_accumulated_energy_consumption_at_desk();
-    float get_instant_power_at_desk();
-    float get_accumulated_visibility_error_at_desk();
-    float get_accumulated_flicker_error_at_desk();
-    void compute_performance_metrics_at_desk(float new_luminance = 0.0, float new_duty_cicle = 0.0);
-    void set_state(bool state);
-    bool get_state();
-    void set_occupied_value(float value);
-    float get_occupied_value();
-    void set_unoccupied_value(float value);
-    float get_unoccupied_value();
-    void set_nominal_power(float value);
-    float get_nominal_power();
+    void reset();
+    float get_accumulated_energy_consumption_at_desk() const { return t_accumulated_energy_consumption.load(std::memory_order_relaxed); }
+    float get_instant_power_at_desk() const { return t_instant_power.load(std::memory_order_relaxed); }
+    float get_accumulated_visibility_error_at_desk() const { return t_accumulated_visibility_error.load(std::memory_order_relaxed); }
+    float get_accumulated_flicker_error_at_desk() const { return t_accumulated_flicker_error.load(std::memory_order_relaxed); }
+    performance_metrics compute_performance_metrics_at_desk(float new_luminance = 0.0, float new_duty_cicle = 0.0);
+    series_stats get_last_minute_stats(char type) const;
+    window_sums get_window_at_desk(float seconds) const { return t_window.query(seconds); }
+    void set_state(bool state) { t_state = state; }
+    bool get_state() const { return t_state; }
+    void set_occupied_value(float value) { t_occupied_value = value; }
+    float get_occupied_value() const { return t_occupied_value; }
+    void set_unoccupied_value(float value) { t_unoccupied_value = value; }
+    float get_unoccupied_value() const { return t_unoccupied_value; }
+    void set_nominal_power(float value) { t_nominal_power = value; }
+    float get_nominal_power() const { return t_nominal_power; }
+};
+
+/*
+ * Values of every desk as a structure of arrays, (address - 1), so the queries about all the desks at once read
+ * contiguous floats and reduce them with the vector kernels
+ */
+struct desk_columns
+{
+    float energy[MAX_DESKS] = {};
+    float power[MAX_DESKS] = {};
+    float visibility[MAX_DESKS] = {};
+    float flicker[MAX_DESKS] = {};
+    float cost[MAX_DESKS];
+    float duty_cicle[MAX_DESKS] = {};
+    float luminance[MAX_DESKS] = {};
+    float occupied[MAX_DESKS];
+    float unoccupied[MAX_DESKS];
+    float state[MAX_DESKS] = {}; // 0 unoccupied, 1 occupied
+
+    desk_columns(); // the settings start as the ones of a new lamp
+    const float *column(char type) const; // one of DESK_COLUMNS
+    float *column(char type) { return const_cast<float *>(static_cast<const desk_columns *>(this)->column(type)); }
+};
+
+/*
+ * Every value of every desk and the totals of the system, all as of the end of the same batch of frames
+ */
+struct office_snapshot
+{
+    int n_desks = 0;
+    float seconds = 0.0; // since the last restart
+    performance_metrics totals;
+    desk_columns desks;
+};
+
+/*
+ * Datagram waiting for the end of the batch of frames that produced it
+ */
+struct udp_datagram
+{
+    std::shared_ptr<const void> owner; // keeps data alive
+    const char *data;
+    size_t size;
+    boost::asio::ip::udp::endpoint endpoint;
 };
 
 /*
@@ -68,45 +161,108 @@ class office
 {
 
 private: // this things are private
-    float t_time_since_last_restart = 0.0;
-    int t_num_lamps = -1; // TODO comando para dar update se houver um restart
+    std::atomic<float> t_time_since_last_restart{0.0};
+    std::atomic<uint32_t> t_ticks{0}; // sample periods since the server started - timestamp of the history, survives restarts
+    std::atomic<uint64_t> t_frames{0}; // frames processed since the server started
+    std::atomic<int> t_num_lamps{-1}; // TODO comando para dar update se houver um restart
+
+    // desks, (address - 1): one block with a cache line aligned slot for each of the MAX_DESKS addresses, reserved
+    // when the office opens and released when it closes. A lamp is built in its slot the first time its address is
+    // used and lives as long as the office, so a reader never holds a freed desk; a restart resets them in place.
+    lamp *t_desks = nullptr;
+    int t_desks_built = 0;            // only the ingest touches it
+    std::atomic<uint32_t> t_epoch{0}; // counts the restarts twice: odd while one is resetting the desks
+
+    // sums of the metrics of every desk, updated by the ingest with the change of each desk
+    std::atomic<double> t_total_energy{0.0};
+    std::atomic<double> t_total_power{0.0};
+    std::atomic<double> t_total_visibility{0.0};
+    std::atomic<double> t_total_flicker{0.0};
 
     // streams
-    boost::asio::ip::udp::socket *t_socket;
+    boost::asio::ip::udp::socket *t_socket = nullptr;           // socket of the UDP server ...
+    boost::asio::io_context::strand *t_udp_strand = nullptr; // ... used from its strand only
+    stream_table t_streams{MAX_DESKS};
+
+    std::mutex t_mutex; // restart - the samples are ingested without it
 
-    std::vector<boost::asio::ip::udp::endpoint> t_udp_endpoints{};
-    std::vector<char> t_udp_stream_type{};
-    std::vector<int> t_udp_stream_address{};
+    // only the ingest touches them, they are published at the end of each batch of frames
+    performance_metrics t_batch_change;
+    std::vector<udp_datagram> t_outbox;
 
-    std::mutex t_mutex;
+    // written by the ingest, read with the seqlock t_columns_version: odd while a batch is changing them
+    desk_columns t_columns;
+    std::atomic<uint32_t> t_columns_version{0};
+    bool t_columns_dirty = false;
+
+    // the changes of the columns are pushed to the TCP subscribers every t_publish_ticks, when there are some
+    subscription_table t_subscriptions;
+    uint32_t t_publish_ticks;      // sample periods between publications
+    uint32_t t_published_tick = 0; // only the ingest touches it
+    bool t_changed = false;        // since the last publication
+
+    const office_settings t_settings;
+    history_store t_history;
+
+    // ingest, one handler per opcode of the hub - returns 1 ack, -1 err or 0 when no client waits for it
+    typedef int (office::*frame_handler)(char command[], int &address, float &value);
+    static const frame_handler *frame_handlers();
+    void ingest_frame(char command[], uint8_t size);
+    void end_batch();
+    int read_setting(char command[], float &value, bool initialized) const;
+    int ingest_restart(char command[], int &address, float &value);
+    int ingest_time(char command[], int &address, float &value);
+    int ingest_occupancy(char command[], int &address, float &value);
+    int ingest_occupied_bound(char command[], int &address, float &value);
+    int ingest_unoccupied_bound(char command[], int &address, float &value);
+    int ingest_cost(char command[], int &address, float &value);
+    int ingest_sample(char command[], int &address, float &value);
+    int ingest_reading(char command[], int &address, float &value);
 
     // functions
     float bytes_2_float(uint8_t most_significative_bit, uint8_t less_significative_bit) const;
     void restart_it_all(int lamps);
-    void udp_stream( int address );
+    void build_desks(int lamps);
+    void add_to_totals(const performance_metrics &change);
+    void udp_stream(int address, float luminance, float duty_cicle);
+    void send_binary_datagram(binary_subscriber &subscriber);
+    void send_udp(std::shared_ptr<const void> owner, const char *data, size_t size, const boost::asio::ip::udp::endpoint &endpoint);
+    void flush_udp();
+    desk_columns &write_columns();
+    void publish_changes();
 
 public: // this things are public
-    // it is access by the async_server
-    lamp **t_lamps_array;
-
-    // async operation
-    std::vector<std::string> t_clients_address{};
-    std::vector<std::string> t_clients_command{};
-    std::vector<int> t_acknowledge{};
+    // commands of the TCP clients waiting for the hub
+    pending_table t_pending{MAX_DESKS};
 
-    office(uint8_t numLamps);
+    office(uint8_t numLamps, const office_settings &settings = office_settings());
     ~office();
 
+    const office_settings &get_settings() const { return t_settings; }
+    size_t get_minute_points() const { return t_settings.minute_points(); }
     double get_elapesd_time_since_last_restart() { return t_time_since_last_restart; }
+    uint64_t get_num_frames() const { return t_frames.load(std::memory_order_relaxed); }
     void updates_database(char command[], uint8_t size);
+    void updates_database_batch(hub_frame frames[], size_t n_frames);
     void float_2_bytes(float fnum, u_int8_t bytes[2]) const;
 
-    float get_accumulated_energy_consumption();
-    float get_instant_power();
-    float get_accumulated_visibility_error();
-    float get_accumulated_flicker_error();
-    int set_upd_stream(char type, int address, boost::asio::ip::udp::socket *socket, boost::asio::ip::udp::endpoint endpoint);
-    int get_num_lamps();
+    float get_accumulated_energy_consumption() const { return t_total_energy.load(std::memory_order_relaxed); }
+    float get_instant_power() const { return t_total_power.load(std::memory_order_relaxed); }
+    float get_accumulated_visibility_error() const { return t_total_visibility.load(std::memory_order_relaxed); }
+    float get_accumulated_flicker_error() const { return t_total_flicker.load(std::memory_order_relaxed); }
+    void set_udp_socket(boost::asio::ip::udp::socket *socket, boost::asio::io_context::strand *strand);
+    int set_upd_stream(char type, int address, boost::asio::ip::udp::endpoint endpoint);
+    int set_binary_stream(char type, int address, boost::asio::ip::udp::endpoint endpoint);
+    int get_num_lamps() const { return t_num_lamps; }
+    uint32_t get_epoch() const { return t_epoch.load(std::memory_order_acquire); }
+    lamp &desk(int address) { return t_desks[address - 1]; } // 1 <= address <= get_num_lamps()
+    const lamp &desk(int address) const { return t_desks[address - 1]; }
+    size_t get_history(char type, int address, float seconds, std::vector<float> &values) const;
+    performance_metrics get_window_metrics(int address, float seconds) const;
+    size_t get_all_desks(char type, float values[MAX_DESKS]) const;
+    void get_snapshot(office_snapshot &snapshot) const;
+    void subscribe(metric_subscriber *subscriber) { t_subscriptions.add(subscriber); }
+    void unsubscribe(metric_subscriber *subscriber) { t_subscriptions.remove(subscriber); }
 };
 
 #endif
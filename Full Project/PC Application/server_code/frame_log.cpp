@@ -0,0 +1,307 @@
+#include "frame_log.hpp"
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <cstdio>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static_assert(sizeof(frame_record) == 16, "frame_record must stay 16 bytes, it is the on-disk format");
+
+static uint8_t record_check(const frame_record &record)
+{
+    const uint8_t *bytes = (const uint8_t *)&record;
+    uint8_t check = 0x5A;
+    for (size_t i = 0; i < offsetof(frame_record, check); i++)
+    {
+        check ^= bytes[i];
+    }
+    return check;
+}
+
+frame_log::frame_log(const std::string &directory) : t_directory(directory)
+{
+    mkdir(t_directory.c_str(), 0755);
+
+    DIR *dir = opendir(t_directory.c_str());
+    if (!dir)
+    {
+        if (DEBUG)
+            std::cout << "Could not open the frame log directory '" << t_directory << "'\n";
+        t_available = false;
+        return;
+    }
+
+    // finds the segments left by previous runs
+    struct dirent *entry;
+    while ((entry = readdir(dir)) != nullptr)
+    {
+        unsigned long long sequence = 0;
+        char extension[8]{};
+        if (sscanf(entry->d_name, "frames_%llu.%7s", &sequence, extension) == 2 && !strcmp(extension, "log"))
+        {
+            t_segments.push_back(sequence);
+        }
+    }
+    closedir(dir);
+
+    std::sort(t_segments.begin(), t_segments.end());
+
+    if (DEBUG)
+        std::cout << "Frame log at '" << t_directory << "' with " << t_segments.size() << " segment" << ((t_segments.size() != 1) ? "s" : "") << "\n";
+}
+
+frame_log::~frame_log()
+{
+    close_segment();
+}
+
+std::string frame_log::segment_path(uint64_t sequence) const
+{
+    char name[32];
+    snprintf(name, sizeof(name), "frames_%08llu.log", (unsigned long long)sequence);
+    return t_directory + "/" + name;
+}
+
+/*
+ * Creates the next segment and maps it, deleting the oldest ones above FRAME_LOG_MAX_SEGMENTS
+ */
+bool frame_log::open_segment()
+{
+    uint64_t sequence = t_segments.empty() ? 1 : t_segments.back() + 1;
+    std::string path = segment_path(sequence);
+
+    t_fd = open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+    if (t_fd < 0 || ftruncate(t_fd, FRAME_LOG_SEGMENT_BYTES) != 0)
+    {
+        if (DEBUG)
+            std::cout << "Could not create the frame log segment '" << path << "'\n";
+        close_segment();
+        return false;
+    }
+
+    void *map = mmap(nullptr, FRAME_LOG_SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, t_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        if (DEBUG)
+            std::cout << "Could not map the frame log segment '" << path << "'\n";
+        close_segment();
+        return false;
+    }
+    t_map = (char *)map;
+
+    // header: magic, version and record size
+    frame_record header{};
+    std::memcpy(&header, FRAME_LOG_MAGIC, 8);
+    uint32_t version = FRAME_LOG_VERSION;
+    uint32_t record_size = sizeof(frame_record);
+    std::memcpy((char *)&header + 8, &version, 4);
+    std::memcpy((char *)&header + 12, &record_size, 4);
+    std::memcpy(t_map, &header, sizeof(header));
+
+    t_next = 1;
+    t_capacity = FRAME_LOG_SEGMENT_BYTES / sizeof(frame_record);
+    t_segments.push_back(sequence);
+
+    while (t_segments.size() > FRAME_LOG_MAX_SEGMENTS)
+    {
+        unlink(segment_path(t_segments.front()).c_str());
+        t_segments.erase(t_segments.begin());
+    }
+    return true;
+}
+
+/*
+ * Maps the newest segment again to append after its last record - false when there is none, it is full, or its end
+ * is not clean (a torn record, e.g. after a crash), and then the next segment is created
+ */
+bool frame_log::reopen_segment()
+{
+    if (t_segments.empty())
+    {
+        return false;
+    }
+
+    std::string path = segment_path(t_segments.back());
+    struct stat info;
+    t_fd = open(path.c_str(), O_RDWR);
+    if (t_fd < 0 || fstat(t_fd, &info) != 0 || info.st_size != FRAME_LOG_SEGMENT_BYTES)
+    {
+        close_segment();
+        return false;
+    }
+
+    void *map = mmap(nullptr, FRAME_LOG_SEGMENT_BYTES, PROT_READ | PROT_WRITE, MAP_SHARED, t_fd, 0);
+    if (map == MAP_FAILED)
+    {
+        close_segment();
+        return false;
+    }
+    t_map = (char *)map;
+    t_capacity = FRAME_LOG_SEGMENT_BYTES / sizeof(frame_record);
+
+    uint32_t version = 0;
+    uint32_t record_size = 0;
+    std::memcpy(&version, t_map + 8, 4);
+    std::memcpy(&record_size, t_map + 12, 4);
+    bool clean = !std::memcmp(t_map, FRAME_LOG_MAGIC, 8) && version == FRAME_LOG_VERSION && record_size == sizeof(frame_record);
+
+    // the written part ends at the first empty record, and everything after it must be empty too
+    const frame_record *records = (const frame_record *)t_map;
+    size_t next = 1;
+    while (clean && next < t_capacity && records[next].size != 0 && records[next].check == record_check(records[next]))
+    {
+        next++;
+    }
+    for (size_t r = next; clean && r < t_capacity; r++)
+    {
+        clean = records[r].size == 0;
+    }
+
+    if (!clean || next == t_capacity)
+    {
+        close_segment();
+        return false;
+    }
+    t_next = next;
+
+    if (DEBUG)
+        std::cout << "Appending to '" << path << "' after " << t_next - 1 << " frames\n";
+    return true;
+}
+
+void frame_log::close_segment()
+{
+    if (t_map)
+    {
+        msync(t_map, FRAME_LOG_SEGMENT_BYTES, MS_ASYNC);
+        munmap(t_map, FRAME_LOG_SEGMENT_BYTES);
+        t_map = nullptr;
+    }
+    if (t_fd >= 0)
+    {
+        close(t_fd);
+        t_fd = -1;
+    }
+}
+
+/*
+ * Stores a frame read from the hub - only the serial reader may call it
+ */
+void frame_log::append(const char command[], uint8_t size)
+{
+    if (!t_available)
+        return;
+
+    if (!t_map && !t_segments.empty())
+    {
+        reopen_segment(); // the first frame of this run goes after the ones of the previous run
+    }
+    if (!t_map || t_next == t_capacity) // rotates segment
+    {
+        close_segment();
+        if (!open_segment())
+        {
+            t_available = false;
+            return;
+        }
+    }
+
+    frame_record record{};
+    record.timestamp_us = std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::system_clock::now().time_since_epoch()).count();
+    record.size = size > sizeof(record.frame) ? sizeof(record.frame) : size;
+    std::memcpy(record.frame, command, record.size);
+    record.check = record_check(record);
+
+    std::memcpy(t_map + t_next * sizeof(frame_record), &record, sizeof(record));
+    t_next++;
+}
+
+/*
+ * Feeds every frame stored on disk to the office, from the oldest segment to the newest
+ */
+size_t frame_log::replay(office *the_office)
+{
+    size_t n_frames = scan([the_office](const frame_record &record) {
+        char command[sizeof(record.frame)]{};
+        std::memcpy(command, record.frame, record.size);
+        if (command[0] == 'A') // a restart clears the metrics, but the number of desks is the one of the hub connected now
+        {
+            command[1] = (char)(uint8_t)the_office->get_num_lamps();
+        }
+        the_office->updates_database(command, record.size);
+    });
+
+    if (DEBUG)
+        std::cout << "Replayed " << n_frames << " frames from the frame log\n";
+    return n_frames;
+}
+
+/*
+ * Visits every valid record stored on disk, from the oldest segment to the newest
+ */
+size_t frame_log::scan(const std::function<void(const frame_record &)> &visit) const
+{
+    size_t n_frames = 0;
+    for (size_t i = 0; i < t_segments.size(); i++)
+    {
+        n_frames += scan_segment(t_segments[i], visit);
+    }
+    return n_frames;
+}
+
+size_t frame_log::scan_segment(uint64_t sequence, const std::function<void(const frame_record &)> &visit) const
+{
+    std::string path = segment_path(sequence);
+    int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0)
+        return 0;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || info.st_size < (off_t)sizeof(frame_record))
+    {
+        close(fd);
+        return 0;
+    }
+
+    size_t length = info.st_size;
+    void *map = mmap(nullptr, length, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return 0;
+
+    const frame_record *records = (const frame_record *)map;
+    size_t n_records = length / sizeof(frame_record);
+    size_t n_frames = 0;
+
+    uint32_t record_size = 0;
+    std::memcpy(&record_size, (const char *)map + 12, 4);
+
+    if (!std::memcmp(map, FRAME_LOG_MAGIC, 8) && record_size == sizeof(frame_record))
+    {
+        madvise(map, length, MADV_SEQUENTIAL);
+
+        for (size_t r = 1; r < n_records; r++)
+        {
+            const frame_record &record = records[r];
+            if (record.size == 0 || record.check != record_check(record))
+            {
+                break;
+            } // end of the written part, or a torn record
+
+            visit(record);
+            n_frames++;
+        }
+    }
+    else if (DEBUG)
+    {
+        std::cout << "Ignoring '" << path << "': it is not a frame log segment\n";
+    }
+
+    munmap(map, length);
+    return n_frames;
+}
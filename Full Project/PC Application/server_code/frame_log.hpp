@@ -0,0 +1,66 @@
+#ifndef FRAME_LOG_HPP
+#define FRAME_LOG_HPP
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <functional>
+#include <cstdint>
+
+#include "database.hpp"
+
+#define FRAME_LOG_DIR "frame_log"
+#define FRAME_LOG_SEGMENT_BYTES (4 * 1024 * 1024) // each segment holds 262143 frames, ~15 min of 3 desks at 100 Hz
+#define FRAME_LOG_MAX_SEGMENTS 32                 // the oldest segment is deleted after this
+#define FRAME_LOG_MAGIC "SCDTRLOG"
+#define FRAME_LOG_VERSION 1
+
+/*
+ * One frame read from the hub, as it arrived, plus the time it was received
+ */
+struct frame_record
+{
+    uint64_t timestamp_us; // receive time, microseconds since epoch
+    uint8_t size;          // 4 or 6 bytes, 0 marks the end of the segment
+    char frame[6];
+    uint8_t check; // xor of every other byte of the record, detects torn records
+};
+
+/*
+ * Append-only binary log of the serial stream.
+ *
+ * Segments are fixed-size files mapped in memory, so appending a frame is a memcpy and the kernel writes the pages
+ * back in the background: there is no syscall per frame and the data survives a crash of the server. A new run of the
+ * server appends to the newest segment while it has room, so restarts do not rotate the history out with empty segments.
+ */
+class frame_log
+{
+
+private: // this things are private
+    std::string t_directory;
+    std::vector<uint64_t> t_segments; // sequence numbers of the segments on disk, oldest first
+    bool t_available = true;
+
+    // segment being written
+    int t_fd = -1;
+    char *t_map = nullptr;
+    size_t t_next = 0; // index of the next record
+    size_t t_capacity = 0;
+
+    std::string segment_path(uint64_t sequence) const;
+    bool open_segment();
+    bool reopen_segment();
+    void close_segment();
+    size_t scan_segment(uint64_t sequence, const std::function<void(const frame_record &)> &visit) const;
+
+public: // this things are public
+    frame_log(const std::string &directory = FRAME_LOG_DIR);
+    ~frame_log();
+
+    void append(const char command[], uint8_t size);
+    size_t replay(office *the_office);
+    size_t scan(const std::function<void(const frame_record &)> &visit) const;
+    bool is_available() const { return t_available; }
+};
+
+#endif
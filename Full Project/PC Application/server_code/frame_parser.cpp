@@ -0,0 +1,71 @@
+#include "frame_parser.hpp"
+
+#include <cstring>
+
+/*
+ * Bytes of a frame after its delimiter, 0 when the opcode is unknown
+ */
+uint8_t frame_parser::frame_size(char opcode)
+{
+    if (opcode == FRAME_STREAM_OPCODE)
+    {
+        return 6;
+    }
+    return (opcode && strchr(FRAME_SHORT_OPCODES, opcode)) ? 4 : 0;
+}
+
+/*
+ * Appends every complete frame in the buffer to frames and keeps the unfinished one
+ * returns the number of frames appended
+ */
+size_t frame_parser::parse(std::vector<hub_frame> &frames)
+{
+    size_t n_frames = 0;
+    size_t next = 0; // first byte not consumed
+
+    while (next < t_end)
+    {
+        const char *delimiter = (const char *)memchr(&t_buffer[next], FRAME_DELIMITER, t_end - next);
+        if (!delimiter) // garbage, nothing to keep
+        {
+            t_n_skipped += t_end - next;
+            next = t_end;
+            break;
+        }
+        size_t start = delimiter - t_buffer;
+        t_n_skipped += start - next;
+
+        if (start + 1 >= t_end) // the opcode did not arrive yet
+        {
+            next = start;
+            break;
+        }
+
+        uint8_t size = frame_size(t_buffer[start + 1]);
+        if (!size) // resync on the next delimiter
+        {
+            t_n_skipped++;
+            next = start + 1;
+            continue;
+        }
+        if (start + 1 + size > t_end) // cut by the read
+        {
+            next = start;
+            break;
+        }
+
+        hub_frame frame;
+        frame.size = size;
+        std::memcpy(frame.bytes, &t_buffer[start + 1], size);
+        frames.push_back(frame);
+        n_frames++;
+        next = start + 1 + size;
+    }
+
+    // the unfinished frame, at most FRAME_MAX_BYTES, goes to the front
+    t_end -= next;
+    std::memmove(t_buffer, &t_buffer[next], t_end);
+
+    t_n_frames += n_frames;
+    return n_frames;
+}
@@ -0,0 +1,55 @@
+#ifndef FRAME_PARSER_HPP
+#define FRAME_PARSER_HPP
+
+#include <vector>
+#include <cstdint>
+#include <cstddef>
+
+#define FRAME_DELIMITER '+'
+#define FRAME_MAX_BYTES 6                // '+s' frames, every other frame has 4 bytes
+#define FRAME_PARSER_BUFFER_BYTES 4096 // ~680 samples, several ticks of 255 desks at 100 Hz
+#define FRAME_SHORT_OPCODES "AtoOUcxr" // opcodes of the 4 byte frames
+#define FRAME_STREAM_OPCODE 's'
+
+/*
+ * One frame of the hub, without its delimiter
+ */
+struct hub_frame
+{
+    uint8_t size; // 4 or 6
+    char bytes[FRAME_MAX_BYTES];
+};
+
+/*
+ * Splits the bytes read from the serial port into frames.
+ *
+ * The reader writes straight into the buffer of the parser with one large read, and every complete frame found is
+ * parsed in one pass. A frame is a delimiter, an opcode and a fixed number of bytes given by the opcode, so the value
+ * bytes may hold a delimiter too. On an unknown opcode the parser resyncs on the next delimiter. The bytes of a
+ * frame cut by the read are kept for the next one.
+ */
+class frame_parser
+{
+
+private: // this things are private
+    char t_buffer[FRAME_PARSER_BUFFER_BYTES];
+    size_t t_end = 0; // bytes in the buffer, it always starts at the first byte not parsed
+
+    uint64_t t_n_frames = 0;
+    uint64_t t_n_skipped = 0; // bytes dropped while looking for a delimiter
+
+public: // this things are public
+    static uint8_t frame_size(char opcode);
+
+    char *write_pointer() { return &t_buffer[t_end]; }
+    size_t write_space() const { return FRAME_PARSER_BUFFER_BYTES - t_end; }
+    void commit(size_t n_bytes) { t_end += n_bytes; }
+
+    size_t parse(std::vector<hub_frame> &frames);
+    void reset() { t_end = 0; }
+
+    uint64_t get_num_frames() const { return t_n_frames; }
+    uint64_t get_num_skipped() const { return t_n_skipped; }
+};
+
+#endif
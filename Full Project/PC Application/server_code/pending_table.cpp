@@ -0,0 +1,224 @@
+#include "pending_table.hpp"
+
+#include <cstring>
+#include <algorithm>
+
+#define PENDING_POOL_GROWTH 64 // requests allocated at once when the free list is empty
+
+pending_table::pending_table(int max_desks) : t_max_desks(max_desks)
+{
+    t_slots.assign(strlen(PENDING_OPCODES) * (max_desks + 1), nullptr);
+}
+
+/*
+ * Index of (opcode, desk) in the table, -1 when it can not be pending
+ */
+int pending_table::slot(char opcode, int desk) const
+{
+    const char *found = opcode ? strchr(PENDING_OPCODES, opcode) : nullptr;
+    if (!found || desk < 0 || desk > t_max_desks)
+    {
+        return -1;
+    }
+    return (found - PENDING_OPCODES) * (t_max_desks + 1) + desk;
+}
+
+pending_request *pending_table::allocate()
+{
+    if (!t_free)
+    {
+        for (int i = 0; i < PENDING_POOL_GROWTH; i++)
+        {
+            t_storage.push_back(std::unique_ptr<pending_request>(new pending_request));
+            t_storage.back()->key_next = t_free;
+            t_free = t_storage.back().get();
+        }
+    }
+
+    pending_request *request = t_free;
+    t_free = request->key_next;
+    *request = pending_request();
+    return request;
+}
+
+/*
+ * Unlinks the request from its slot and from its connection, and recycles it
+ */
+void pending_table::release(pending_request *request)
+{
+    // slot
+    if (request->key_prev)
+    {
+        request->key_prev->key_next = request->key_next;
+    }
+    else
+    {
+        t_slots[slot(request->opcode, request->desk)] = request->key_next;
+    }
+    if (request->key_next)
+    {
+        request->key_next->key_prev = request->key_prev;
+    }
+
+    // connection
+    if (request->owner_prev)
+    {
+        request->owner_prev->owner_next = request->owner_next;
+    }
+    else
+    {
+        request->owner->head = request->owner_next;
+    }
+    if (request->owner_next)
+    {
+        request->owner_next->owner_prev = request->owner_prev;
+    }
+    request->owner->size--;
+    t_size--;
+
+    request->key_prev = nullptr;
+    request->key_next = t_free;
+    t_free = request;
+}
+
+/*
+ * Registers a request of the connection <owner>
+ * returns its id, or 0 when the same command is already waiting for the hub or it can not be pending
+ */
+uint64_t pending_table::submit(pending_list *owner, char opcode, int desk, int value, int64_t tag)
+{
+    int index = slot(opcode, desk);
+    if (index < 0)
+    {
+        return 0;
+    }
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    for (pending_request *other = t_slots[index]; other; other = other->key_next) // command already in stack
+    {
+        if (other->value == value && other->result == PENDING_WAITING)
+        {
+            return 0;
+        }
+    }
+
+    pending_request *request = allocate();
+    request->id = t_next_id++;
+    request->opcode = opcode;
+    request->desk = desk;
+    request->value = value;
+    request->tag = tag;
+    request->owner = owner;
+
+    request->key_next = t_slots[index];
+    if (request->key_next)
+    {
+        request->key_next->key_prev = request;
+    }
+    t_slots[index] = request;
+
+    request->owner_next = owner->head;
+    if (request->owner_next)
+    {
+        request->owner_next->owner_prev = request;
+    }
+    owner->head = request;
+    owner->size++;
+    t_size++;
+
+    return request->id;
+}
+
+/*
+ * Stores the answer of the hub in the requests waiting for (opcode, desk) - and for <value>, when match_value
+ * returns how many connections were told
+ */
+size_t pending_table::resolve(char opcode, int desk, int value, int result, bool match_value)
+{
+    int index = slot(opcode, desk);
+    if (index < 0)
+    {
+        return 0;
+    }
+    std::vector<pending_list *> owners; // to tell, once the lock is released
+    {
+        std::lock_guard<std::mutex> lock(t_mutex);
+
+        for (pending_request *request = t_slots[index]; request; request = request->key_next)
+        {
+            if (request->result == PENDING_WAITING && (!match_value || request->value == value))
+            {
+                request->result = result;
+                if (std::find(owners.begin(), owners.end(), request->owner) == owners.end())
+                {
+                    owners.push_back(request->owner);
+                }
+            }
+        }
+    }
+
+    for (size_t i = 0; i < owners.size(); i++)
+    {
+        if (owners[i]->on_completed)
+        {
+            owners[i]->on_completed();
+        }
+    }
+    return owners.size();
+}
+
+/*
+ * Removes the answered requests of the connection and appends them to completed
+ */
+size_t pending_table::take_completed(pending_list *owner, std::vector<completed_request> &completed)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    size_t n_completed = 0;
+    pending_request *request = owner->head;
+    while (request)
+    {
+        pending_request *next = request->owner_next;
+        if (request->result != PENDING_WAITING)
+        {
+            completed.push_back(completed_request{request->id, request->opcode, request->desk, request->result, request->tag});
+            release(request);
+            n_completed++;
+        }
+        request = next;
+    }
+    return n_completed;
+}
+
+/*
+ * Forgets every request of the connection, e.g. when it leaves
+ */
+void pending_table::cancel_all(pending_list *owner)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    while (owner->head)
+    {
+        release(owner->head);
+    }
+}
+
+/*
+ * Forgets every request but the ones of <opcode>, e.g. on a restart of the hub
+ */
+void pending_table::clear_except(char opcode)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    for (size_t index = 0; index < t_slots.size(); index++)
+    {
+        while (t_slots[index] && t_slots[index]->opcode != opcode)
+        {
+            release(t_slots[index]);
+        }
+    }
+}
+
+size_t pending_table::size() const
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    return t_size;
+}
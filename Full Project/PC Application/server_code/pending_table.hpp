@@ -0,0 +1,91 @@
+#ifndef PENDING_TABLE_HPP
+#define PENDING_TABLE_HPP
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+#define PENDING_OPCODES "oOUcxrA" // set commands, get commands answered by the hub and the restart
+#define PENDING_WAITING -2       // result of a request without answer from the hub
+
+/*
+ * Command of a TCP client waiting for the answer of the hub
+ */
+struct pending_request
+{
+    uint64_t id = 0; // unique, 0 is never used
+    char opcode = 0;
+    int desk = 0;
+    int value = 0;                  // tenths of the value set, matched against the echo of the hub
+    int result = PENDING_WAITING; // 1 ack, -1 err, or tenths of the value read for 'x' and 'r'
+    int64_t tag = -1;             // given by the client to match the answer, -1 none
+
+    // intrusive links: requests with the same (opcode, desk) and requests of the same connection
+    pending_request *key_prev = nullptr;
+    pending_request *key_next = nullptr;
+    pending_request *owner_prev = nullptr;
+    pending_request *owner_next = nullptr;
+    struct pending_list *owner = nullptr;
+};
+
+/*
+ * Requests of one connection - it is owned by the connection and changed by the pending_table only
+ */
+struct pending_list
+{
+    pending_request *head = nullptr;
+    size_t size = 0;
+    std::function<void()> on_completed; // called, without the lock of the table, when the hub answers a request of the list
+};
+
+/*
+ * Answer of the hub to a request, handed to its connection
+ */
+struct completed_request
+{
+    uint64_t id;
+    char opcode;
+    int desk;
+    int result;
+    int64_t tag;
+};
+
+/*
+ * Commands sent to the hub and still waiting for its answer, indexed by (opcode, desk).
+ *
+ * An answer of the hub only visits the requests of its (opcode, desk) slot, and each connection finds its own requests
+ * in its intrusive list, so nothing scans the whole table. The requests are recycled through a free list.
+ * The owner of an answered request is told right away through on_completed, so nobody polls the table.
+ */
+class pending_table
+{
+
+private: // this things are private
+    std::vector<pending_request *> t_slots; // opcode * (max desks + 1) + desk
+    std::vector<std::unique_ptr<pending_request>> t_storage;
+    pending_request *t_free = nullptr;
+    uint64_t t_next_id = 1;
+    size_t t_size = 0; // requests in the table
+    const int t_max_desks = 0;
+
+    mutable std::mutex t_mutex; // io threads submit and collect, the ingest resolves
+
+    int slot(char opcode, int desk) const;
+    pending_request *allocate();
+    void release(pending_request *request);
+
+public: // this things are public
+    pending_table(int max_desks);
+
+    uint64_t submit(pending_list *owner, char opcode, int desk, int value = 0, int64_t tag = -1);
+    size_t resolve(char opcode, int desk, int value, int result, bool match_value);
+    size_t take_completed(pending_list *owner, std::vector<completed_request> &completed);
+    void cancel_all(pending_list *owner);
+    void clear_except(char opcode);
+    size_t size() const;
+};
+
+#endif
@@ -0,0 +1,130 @@
+#include "reply_pool.hpp"
+
+#include <cstdio>
+#include <cstring>
+#include <algorithm>
+
+/* --------------------------------------------------------------------------------
+   |                                  Pool                                        |
+   -------------------------------------------------------------------------------- */
+
+reply_pool::~reply_pool()
+{
+    while (t_free)
+    {
+        reply_buffer *buffer = t_free;
+        t_free = buffer->next;
+        delete buffer;
+    }
+}
+
+reply_buffer *reply_pool::acquire()
+{
+    if (!t_free)
+    {
+        return new reply_buffer; // the pool is still warming up, or many answers are in flight
+    }
+    reply_buffer *buffer = t_free;
+    t_free = buffer->next;
+    t_idle--;
+    buffer->size = 0;
+    return buffer;
+}
+
+void reply_pool::release(reply_buffer *buffer)
+{
+    if (t_idle == REPLY_POOL_IDLE)
+    {
+        delete buffer;
+        return;
+    }
+    buffer->next = t_free;
+    t_free = buffer;
+    t_idle++;
+}
+
+/* --------------------------------------------------------------------------------
+   |                                  Writer                                      |
+   -------------------------------------------------------------------------------- */
+
+reply_writer &reply_writer::put(char c)
+{
+    if (*t_size < t_capacity)
+    {
+        t_data[(*t_size)++] = c;
+    }
+    return *this;
+}
+
+reply_writer &reply_writer::put(const char *text)
+{
+    size_t length = std::min(std::strlen(text), t_capacity - *t_size);
+    std::memcpy(&t_data[*t_size], text, length);
+    *t_size += length;
+    return *this;
+}
+
+reply_writer &reply_writer::put_integer(long long number)
+{
+    char digits[24];
+    size_t n = 0;
+    unsigned long long magnitude = number < 0 ? 0ULL - (unsigned long long)number : (unsigned long long)number;
+    do
+    {
+        digits[n++] = (char)('0' + magnitude % 10);
+        magnitude /= 10;
+    } while (magnitude);
+
+    if (number < 0)
+    {
+        put('-');
+    }
+    while (n)
+    {
+        put(digits[--n]);
+    }
+    return *this;
+}
+
+reply_writer &reply_writer::put_number(double number)
+{
+    size_t space = t_capacity - *t_size;
+    int length = std::snprintf(&t_data[*t_size], space, "%f", number); // writes on the stack, never on the heap
+    if (length > 0)
+    {
+        *t_size += std::min((size_t)length, space ? space - 1 : 0); // without the terminator
+    }
+    return *this;
+}
+
+/* --------------------------------------------------------------------------------
+   |                              Handler memory                                  |
+   -------------------------------------------------------------------------------- */
+
+void *handler_memory::allocate(size_t size)
+{
+    if (size <= HANDLER_MEMORY_BYTES)
+    {
+        for (int i = 0; i < HANDLER_MEMORY_SLOTS; i++)
+        {
+            if (!t_slots[i].in_use.exchange(true, std::memory_order_acquire))
+            {
+                return t_slots[i].bytes;
+            }
+        }
+    }
+    return ::operator new(size);
+}
+
+void handler_memory::deallocate(void *pointer)
+{
+    for (int i = 0; i < HANDLER_MEMORY_SLOTS; i++)
+    {
+        if (pointer == t_slots[i].bytes)
+        {
+            t_slots[i].in_use.store(false, std::memory_order_release);
+            return;
+        }
+    }
+    ::operator delete(pointer);
+}
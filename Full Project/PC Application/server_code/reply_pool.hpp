@@ -0,0 +1,157 @@
+#ifndef REPLY_POOL_HPP
+#define REPLY_POOL_HPP
+
+// /*
+// Memory of the answers of the servers: pooled buffers, a writer that formats into them and the memory of the asio
+// operations, so that once a connection is warm answering a request does not reach the heap
+// */
+
+#include <cstddef>
+#include <atomic>
+#include <new>
+#include <utility>
+
+#define REPLY_BUFFER_BYTES 8192  // the answers of the commands of one read, sent in one write
+#define REPLY_MAX_BYTES 4096     // longest answer: 'g A' of every desk
+#define REPLY_POOL_IDLE 8        // buffers kept by a pool for reuse, the others are freed when they come back
+#define HANDLER_MEMORY_SLOTS 4   // asio operations of one connection at once: the read and a few writes
+#define HANDLER_MEMORY_BYTES 512 // an asio operation with its handler
+
+/*
+ * Buffer of one or more answers
+ */
+struct reply_buffer
+{
+    reply_buffer *next = nullptr; // free list of the pool, or queue of the writes of a connection
+    size_t size = 0;
+    char data[REPLY_BUFFER_BYTES];
+};
+
+/*
+ * Buffers of the answers of one connection. Only the strand of the connection takes and returns them: the answer is
+ * formatted straight into a buffer, which is returned when its write completes.
+ */
+class reply_pool
+{
+
+private: // this things are private
+    reply_buffer *t_free = nullptr;
+    size_t t_idle = 0;
+
+public: // this things are public
+    reply_pool() {}
+    reply_pool(const reply_pool &) = delete;
+    reply_pool &operator=(const reply_pool &) = delete;
+    ~reply_pool();
+
+    reply_buffer *acquire();
+    void release(reply_buffer *buffer);
+};
+
+/*
+ * Formats text into a buffer like std::to_string does, without allocating. What does not fit is cut.
+ * A writer that appends only clears and cuts what it wrote itself.
+ */
+class reply_writer
+{
+
+private: // this things are private
+    char *t_data;
+    size_t t_capacity;
+    size_t *t_size;
+    size_t t_start; // what was in the buffer before this writer
+
+public: // this things are public
+    reply_writer(char *data, size_t capacity, size_t *size, bool append = false) : t_data(data), t_capacity(capacity), t_size(size), t_start(append ? *size : 0) { *t_size = t_start; }
+    explicit reply_writer(reply_buffer *buffer, bool append = false) : reply_writer(buffer->data, REPLY_BUFFER_BYTES, &buffer->size, append) {}
+
+    reply_writer &put(char c);
+    reply_writer &put(const char *text);
+    reply_writer &put_integer(long long number);
+    reply_writer &put_number(double number); // "%f"
+    void clear() { *t_size = t_start; }
+    void cut(size_t n) { *t_size -= n < size() ? n : size(); } // drops the last <n> characters
+    size_t size() const { return *t_size - t_start; }
+};
+
+/*
+ * Memory of the asio operations of one connection. They are taken from the strand of the connection but may be
+ * returned from any io thread, so each slot is claimed with an atomic. What does not fit goes to the heap.
+ */
+class handler_memory
+{
+
+private: // this things are private
+    struct slot
+    {
+        alignas(alignof(std::max_align_t)) char bytes[HANDLER_MEMORY_BYTES];
+        std::atomic<bool> in_use{false};
+    };
+    slot t_slots[HANDLER_MEMORY_SLOTS];
+
+public: // this things are public
+    handler_memory() {}
+    handler_memory(const handler_memory &) = delete;
+    handler_memory &operator=(const handler_memory &) = delete;
+
+    void *allocate(size_t size);
+    void deallocate(void *pointer);
+};
+
+/*
+ * Allocator over a handler_memory, the one asio asks the handler for
+ */
+template <class T>
+class handler_allocator
+{
+public:
+    typedef T value_type;
+
+    explicit handler_allocator(handler_memory &memory) : t_memory(&memory) {}
+    template <class U>
+    handler_allocator(const handler_allocator<U> &other) : t_memory(other.t_memory) {}
+
+    T *allocate(size_t n) { return static_cast<T *>(t_memory->allocate(sizeof(T) * n)); }
+    void deallocate(T *pointer, size_t) { t_memory->deallocate(pointer); }
+
+    bool operator==(const handler_allocator &other) const { return t_memory == other.t_memory; }
+    bool operator!=(const handler_allocator &other) const { return t_memory != other.t_memory; }
+
+private:
+    template <class>
+    friend class handler_allocator;
+    handler_memory *t_memory;
+};
+
+/*
+ * Completion handler whose operation lives in a handler_memory: through its allocator and through the allocation
+ * hooks, which are the ones the socket operations of this version of asio use
+ */
+template <class Handler>
+class memory_handler
+{
+public:
+    typedef handler_allocator<Handler> allocator_type;
+
+    memory_handler(handler_memory &memory, Handler handler) : t_memory(&memory), t_handler(std::move(handler)) {}
+
+    allocator_type get_allocator() const { return allocator_type(*t_memory); }
+
+    template <class... Args>
+    void operator()(Args &&... args) { t_handler(std::forward<Args>(args)...); }
+
+    friend void *asio_handler_allocate(size_t size, memory_handler *self) { return self->t_memory->allocate(size); }
+    friend void asio_handler_deallocate(void *pointer, size_t, memory_handler *self) { self->t_memory->deallocate(pointer); }
+
+private:
+    handler_memory *t_memory;
+    Handler t_handler;
+};
+
+template <class Handler>
+inline memory_handler<Handler> make_memory_handler(handler_memory &memory, Handler handler)
+{
+    return memory_handler<Handler>(memory, std::move(handler));
+}
+
+#endif
@@ -1,14 +1,14 @@
 #include "serial.hpp"
 
 // communications::communications( boost::asio::serial_port* s)
-communications::communications(boost::asio::io_context *io)
+communications::communications(boost::asio::io_context *io, const std::string &port, unsigned int baud) : t_strand(*io)
 {
     if (DEBUG)
         std::cout << "This is the initial message of the Serial communication :)\n"; // welcome message
 
     t_serial = std::unique_ptr<boost::asio::serial_port>(new boost::asio::serial_port{*io});
 
-    t_serial->open(RPI_PORT, t_ec); //connect to port
+    t_serial->open(port, t_ec); //connect to port
 
     if (t_ec) // problems with serial
     {
@@ -19,7 +19,7 @@ communications::communications(boost::asio::io_context *io)
         return;
     }
 
-    t_serial->set_option(boost::asio::serial_port_base::baud_rate{BAUD_RATE}, t_ec);
+    t_serial->set_option(boost::asio::serial_port_base::baud_rate{baud}, t_ec);
 }
 
 communications::~communications()
@@ -30,6 +30,21 @@ communications::~communications()
     t_serial->close();
 }
 
+/*
+*   Aborts the read of the frames, the reader stops at its error
+*/
+void communications::stop_reading()
+{
+    boost::asio::post(t_strand, [this]() {
+        t_stopped = true;
+        if (t_coms_available)
+        {
+            boost::system::error_code ec;
+            t_serial->cancel(ec);
+        }
+    });
+}
+
 /*
 *   Connects to a Arduino and returns the number of desks
 */
@@ -78,72 +93,43 @@ uint8_t communications::has_hub()
 */
 void communications::write_command(std::string command)
 {
-    boost::asio::write(*t_serial, boost::asio::buffer(command), t_ec);
-}
-
-/*
-*   Reads Arduino's commands asyncronously
-*/
-void communications::read_async_command(office *the_office)
-{ // https://web.fe.up.pt/~ee96100/projecto/Tabela%20ascii.htm
-    if (!t_coms_available)
-        return;
-
-    async_read(*t_serial, t_buf_command,
-               [this, the_office](const boost::system::error_code &t_ec, std::size_t len) {
-                   // creats command variable
-                   char command1[BUFFER_SIZE_COMMAND]{};
-                   t_buf_command.sgetn(command1, BUFFER_SIZE_COMMAND);
-
-                   if (command1[0] == 's') // stream
-                   {
-                       char command2[BUFFER_SIZE_STREAM - BUFFER_SIZE_COMMAND]{};
-                       boost::asio::streambuf aux_{BUFFER_SIZE_STREAM - BUFFER_SIZE_COMMAND};
-                       boost::asio::read(*t_serial, aux_, this->t_ec);
-                       aux_.sgetn(command2, BUFFER_SIZE_STREAM - BUFFER_SIZE_COMMAND);
-
-                       char command[BUFFER_SIZE_STREAM]{};
-
-                       for (int i = 0; i < BUFFER_SIZE_COMMAND; i++)
-                       {
-                           command[i] = command1[i];
-                       }
-                       for (int i = 0; i < BUFFER_SIZE_STREAM - BUFFER_SIZE_COMMAND; i++)
-                       {
-                           command[i + BUFFER_SIZE_COMMAND] = command2[i];
-                       }
-
-                       if (!t_ec)
-                       {
-                           the_office->updates_database(command, BUFFER_SIZE_STREAM);
-                           read_until_asynchronous(the_office, '+');
-                       }
-                   }
-                   else // normal command
-                   {
-                       if (!t_ec)
-                       {
-                           the_office->updates_database(command1, BUFFER_SIZE_COMMAND);
-                           read_until_asynchronous(the_office, '+');
-                       }
-                   }
-               });
+    std::lock_guard<std::mutex> lock(t_write_mutex); // one command at a time, so they never interleave
+    boost::system::error_code ec;
+    boost::asio::write(*t_serial, boost::asio::buffer(command), ec);
 }
 
 /*
-*  Truly implementation of read until delimiter
+*   Reads Arduino's commands asyncronously: each read takes every byte available and all the frames in it go to
+*   the office at once
 */
-void communications::read_until_asynchronous(office *the_office, char delimiter)
+void communications::read_frames_asynchronous(office *the_office)
 {
     if (!t_coms_available)
         return;
 
-    boost::asio::async_read(*t_serial, t_buf,
-                            [this, the_office, delimiter](const boost::system::error_code &t_ec, std::size_t len) {
-                                char trash;
-                                trash = t_buf.sgetc();
-                                t_buf.consume(1);
-
-                                trash == delimiter ? read_async_command(the_office) : read_until_asynchronous(the_office, delimiter);
-                            });
-}
\ No newline at end of file
+    t_serial->async_read_some(boost::asio::buffer(t_parser.write_pointer(), t_parser.write_space()),
+                              boost::asio::bind_executor(t_strand, [this, the_office](const boost::system::error_code &t_ec, std::size_t len) {
+                                  if (t_ec || t_stopped)
+                                  {
+                                      if (DEBUG)
+                                          std::cout << t_ec << " Stopped reading the serial port\n";
+                                      return;
+                                  }
+                                  t_n_reads.store(t_n_reads.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed); // only this handler writes
+
+                                  t_parser.commit(len);
+                                  t_frames.clear();
+                                  t_parser.parse(t_frames);
+
+                                  if (t_log)
+                                  {
+                                      for (size_t i = 0; i < t_frames.size(); i++)
+                                      {
+                                          t_log->append(t_frames[i].bytes, t_frames[i].size);
+                                      }
+                                  }
+                                  the_office->updates_database_batch(t_frames.data(), t_frames.size());
+
+                                  read_frames_asynchronous(the_office);
+                              }));
+}
@@ -7,9 +7,13 @@
 
 #include <iostream>
 #include <string>
+#include <vector>
+#include <atomic>
 #include <boost/asio.hpp>
 
 #include "database.hpp"
+#include "frame_log.hpp"
+#include "frame_parser.hpp"
 
 // Ports
 #define RPI_PORT "/dev/ttyACM0"            // dmesg
@@ -17,7 +21,6 @@
 #define BAUD_RATE 230400                   //230400
 #define ARDUINO_MESSAGE "Arduino"
 #define BUFFER_SIZE_COMMAND 4
-#define BUFFER_SIZE_STREAM 6
 
 /*
  * Controls the Serial comunication
@@ -30,21 +33,30 @@ private: // this things are private
 
     boost::system::error_code t_ec;
     boost::asio::streambuf t_buf_command{BUFFER_SIZE_COMMAND};
-    boost::asio::streambuf t_buf_stream{BUFFER_SIZE_STREAM};
     boost::asio::streambuf t_buf{1};
     bool t_coms_available = true;
+    bool t_stopped = false; // the reader does not read again - only the strand touches it
+    frame_log *t_log = nullptr; // every frame read is appended to it, when set
 
-    // functions
-    void read_async_command(office *the_office);
+    // reader
+    frame_parser t_parser;
+    std::vector<hub_frame> t_frames; // frames of the last read, reused
+    std::atomic<uint64_t> t_n_reads{0};
+
+    boost::asio::io_context::strand t_strand; // runs the reader, and so the ingest
+    std::mutex t_write_mutex;                 // commands are written by any TCP connection
 
 public:                                          // this things are public
-    communications(boost::asio::io_context *io); // constructor
-    ~communications();                           // destructor
+    communications(boost::asio::io_context *io, const std::string &port = RPI_PORT, unsigned int baud = BAUD_RATE); // constructor
+    ~communications();                                                                                              // destructor
 
     uint8_t has_hub();
     void write_command(std::string command);
-    void read_until_asynchronous(office *the_office, char delimiter);
+    void read_frames_asynchronous(office *the_office);
+    void stop_reading();
     void set_coms_not_available() { t_coms_available = false; }
+    void set_frame_log(frame_log *log) { t_log = log; }
+    uint64_t get_num_reads() const { return t_n_reads.load(std::memory_order_relaxed); }
 };
 
 #endif
@@ -1,13 +1,13 @@
 #include "serial.hpp"
 #include "async_server.hpp"
+#include "server_config.hpp"
 
 #include <thread>
-
-#define PORT 18700 // https://stackoverflow.com/questions/3855127/find-and-kill-process-locking-port-3000-on-mac
+#include <unistd.h>
 
 #define INIT_COMMAND "+RPiS"
 #define TIME_TO_SHUT_DOWN 0
-#define NUM_THREADS 4
+#define SERVER_OPTIONS "c:d:t:p:b:o:"
 
 // global variable to control whether the server runs or not
 boost::asio::io_context io;
@@ -31,8 +31,56 @@ void safety_exit( int sig )
         io.stop();  
 }
 
-int main()
+int main(int argc, char *argv[])
 {
+    // the defaults, then the file of -c, then the other options
+    server_config config;
+
+    int opt;
+    while ((opt = getopt(argc, argv, SERVER_OPTIONS)) != -1)
+    {
+        if ((opt == 'c' && config.read_file(optarg) < 0) || opt == '?')
+        {
+            std::cout << "usage: " << argv[0] << " [-c configuration file] [-d serial device] [-t io threads, 0 runs on the main thread]"
+                      << " [-p TCP port] [-b baud] [-o key=value]" << std::endl;
+            return 1;
+        }
+    }
+
+    optind = 1;
+    while ((opt = getopt(argc, argv, SERVER_OPTIONS)) != -1)
+    {
+        std::string value = optarg ? optarg : "";
+        int valid = 1;
+        switch (opt)
+        {
+        case 'd': // serial device of the hub, e.g. the pty of emulator_code/hub_emulator.cpp
+            valid = config.set("device", value);
+            break;
+        case 't':
+            valid = config.set("threads", value);
+            break;
+        case 'p':
+            valid = config.set("tcp_port", value);
+            break;
+        case 'b':
+            valid = config.set("baud", value);
+            break;
+        case 'o': // any setting of the file, e.g. -o sample_ms=20
+        {
+            size_t equal = value.find('=');
+            valid = equal == std::string::npos ? -1 : config.set(value.substr(0, equal), value.substr(equal + 1));
+            break;
+        }
+        }
+        if (valid < 0)
+        {
+            std::cout << "Invalid option -" << (char)opt << " " << value << std::endl;
+            return 1;
+        }
+    }
+    config.print(std::cout);
+
     // close server after x seconds
     boost::asio::steady_timer timer{io};
     start_timer(&timer);
@@ -45,7 +93,7 @@ int main()
     std::signal(SIGTERM, safety_exit);
 
     // init serial
-    communications the_serial{&io};
+    communications the_serial{&io, config.device, config.baud};
 
     uint8_t num_lamps = the_serial.has_hub();
     if (num_lamps <= 0)
@@ -53,29 +101,43 @@ int main()
         std::cout << "Early exit with" << (int)num_lamps << " lamps" << std::endl;
         return 0;
     }
-    office the_office{num_lamps};
+    office the_office{num_lamps, config.office};
 
-    tcp_server server_tcp{&io, PORT, &the_office, &the_serial};
-    udp_server server_udp{&io, PORT + 1, &the_office};
+    // rebuilds the history and the metrics from the frames of the previous runs, then keeps logging the new ones
+    frame_log the_log{config.log_directory};
+    the_log.replay(&the_office);
+    the_serial.set_frame_log(&the_log);
+
+    tcp_server server_tcp{&io, config.tcp_port, &the_office, &the_serial, config.max_connections, config.idle_seconds};
+    udp_server server_udp{&io, config.get_udp_port(), &the_office};
 
     the_serial.write_command(INIT_COMMAND);
-    the_serial.read_until_asynchronous(&the_office, '+');
+    the_serial.read_frames_asynchronous(&the_office);
 
-    std::thread threads[NUM_THREADS];
-    for (int i = 0; i < NUM_THREADS; i++)
+    // every object keeps its state in a strand, so any number of threads may run the io_context
+    std::vector<std::thread> threads;
+    for (int i = 0; i < config.threads; i++)
     {
-        threads[i] = std::thread{[]() { io.run(); }};
+        threads.push_back(std::thread{[]() { io.run(); }});
     }
 
-    for (int i = 0; i < NUM_THREADS; i++)
+    for (int i = 0; i < config.threads; i++)
     {
         threads[i].join();
     }
 
-    if (NUM_THREADS == 0)
+    if (config.threads <= 0)
     {
         io.run();
     }
 
+    // the operations of the servers are allocated in the memory of their connections: they are aborted and run to
+    // their end now, while that memory exists, instead of being destroyed with the io_context after main
+    the_serial.stop_reading();
+    server_tcp.stop();
+    server_udp.stop();
+    io.restart();
+    io.run();
+
     return 0;
 }
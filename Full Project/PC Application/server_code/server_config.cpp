@@ -0,0 +1,159 @@
+#include "server_config.hpp"
+
+#include <fstream>
+#include <cerrno>
+#include <cstdlib>
+
+/*
+ * Whole <text> as an integer in [min, max]
+ * returns 1, or -1 when it is not one
+ */
+static int parse_integer(const std::string &text, long long min, long long max, long long &number)
+{
+    if (text.empty())
+    {
+        return -1;
+    }
+    char *end = nullptr;
+    errno = 0;
+    number = std::strtoll(text.c_str(), &end, 10);
+    if (errno || *end != '\0' || number < min || number > max)
+    {
+        return -1;
+    }
+    return 1;
+}
+
+static std::string trim(const std::string &text)
+{
+    size_t first = text.find_first_not_of(" \t\r\n");
+    if (first == std::string::npos)
+    {
+        return "";
+    }
+    size_t last = text.find_last_not_of(" \t\r\n");
+    return text.substr(first, last - first + 1);
+}
+
+/*
+ * Sets <key> to <value>
+ * returns 1, or -1 when the key is unknown or the value is out of range
+ */
+int server_config::set(const std::string &key, const std::string &value)
+{
+    long long number = 0;
+    int valid = 1;
+
+    if (key == "device")
+    {
+        device = value;
+        valid = value.empty() ? -1 : 1;
+    }
+    else if (key == "log_directory")
+    {
+        log_directory = value;
+        valid = value.empty() ? -1 : 1;
+    }
+    else if (key == "baud")
+    {
+        valid = parse_integer(value, 1, 4000000, number);
+        baud = (unsigned int)number;
+    }
+    else if (key == "tcp_port")
+    {
+        valid = parse_integer(value, 1, 65534, number);
+        tcp_port = (unsigned short)number;
+    }
+    else if (key == "udp_port")
+    {
+        valid = parse_integer(value, 0, 65535, number);
+        udp_port = (unsigned short)number;
+    }
+    else if (key == "threads")
+    {
+        valid = parse_integer(value, 0, 256, number);
+        threads = (int)number;
+    }
+    else if (key == "max_connections")
+    {
+        valid = parse_integer(value, 1, 4096, number);
+        max_connections = (size_t)number;
+    }
+    else if (key == "idle_seconds")
+    {
+        valid = parse_integer(value, 0, 7 * 24 * 3600, number);
+        idle_seconds = (int)number;
+    }
+    else if (key == "sample_ms")
+    {
+        valid = parse_integer(value, 1, 1000, number);
+        office.sample_ms = (int)number;
+    }
+    else if (key == "history_blocks")
+    {
+        valid = parse_integer(value, 1, 1 << 20, number);
+        office.history_blocks = (size_t)number;
+    }
+    else if (key == "window_seconds")
+    {
+        valid = parse_integer(value, 1, 24 * 3600, number);
+        office.window_seconds = (size_t)number;
+    }
+    else if (key == "publish_hz")
+    {
+        valid = parse_integer(value, 1, 1000, number);
+        office.publish_hz = (int)number;
+    }
+    else
+    {
+        std::cout << "Unknown setting " << key << std::endl;
+        return -1;
+    }
+
+    if (valid < 0)
+    {
+        std::cout << "Invalid value of " << key << ": " << value << std::endl;
+    }
+    return valid;
+}
+
+/*
+ * Reads the "key = value" lines of the file at <path>, '#' starts a comment
+ * returns 1, or -1 when it can not be read or a line is not valid
+ */
+int server_config::read_file(const std::string &path)
+{
+    std::ifstream file(path);
+    if (!file)
+    {
+        std::cout << "Could not open the configuration " << path << std::endl;
+        return -1;
+    }
+
+    std::string line;
+    for (int number = 1; std::getline(file, line); number++)
+    {
+        line = trim(line.substr(0, line.find(CONFIG_COMMENT)));
+        if (line.empty())
+        {
+            continue;
+        }
+
+        size_t equal = line.find('=');
+        if (equal == std::string::npos || set(trim(line.substr(0, equal)), trim(line.substr(equal + 1))) < 0)
+        {
+            std::cout << path << ":" << number << ": not a valid setting: " << line << std::endl;
+            return -1;
+        }
+    }
+    return 1;
+}
+
+void server_config::print(std::ostream &out) const
+{
+    out << "device = " << device << " @ " << baud << " baud, TCP " << tcp_port << ", UDP " << get_udp_port()
+        << ", " << threads << " threads, " << max_connections << " clients, idle " << idle_seconds << " s" << std::endl;
+    out << "sample_ms = " << office.sample_ms << " (" << office.minute_points() << " samples a minute), history_blocks = "
+        << office.history_blocks << ", window_seconds = " << office.window_seconds << ", publish_hz = " << office.publish_hz
+        << ", log_directory = " << log_directory << std::endl;
+}
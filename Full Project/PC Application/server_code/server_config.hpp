@@ -0,0 +1,46 @@
+#ifndef SERVER_CONFIG_HPP
+#define SERVER_CONFIG_HPP
+
+// /*
+// Settings of the server chosen when it starts: a file of "key = value" lines, then the options of the command line
+// */
+
+#include <iostream>
+#include <string>
+
+#include "database.hpp"
+#include "serial.hpp"
+#include "async_server.hpp"
+#include "frame_log.hpp"
+
+#define PORT 18700 // https://stackoverflow.com/questions/3855127/find-and-kill-process-locking-port-3000-on-mac
+#define NUM_THREADS 4
+#define CONFIG_COMMENT '#'
+
+/*
+ * Everything the server can be told when it starts, the defaults are the ones it was built with.
+ *
+ * e.g. the 3 desks of the lab at 100 Hz keep the defaults, while an office of 40 desks may trade history for memory:
+ *      sample_ms = 10
+ *      history_blocks = 256
+ *      window_seconds = 900
+ */
+struct server_config
+{
+    std::string device = RPI_PORT;             // serial device of the hub
+    unsigned int baud = BAUD_RATE;
+    unsigned short tcp_port = PORT;
+    unsigned short udp_port = 0;               // 0 - the one after tcp_port
+    int threads = NUM_THREADS;                 // io threads, 0 runs on the main thread
+    size_t max_connections = MAX_CONNECTIONS;  // TCP clients at once
+    int idle_seconds = IDLE_TIMEOUT_SECONDS;   // 0 never closes an idle client
+    std::string log_directory = FRAME_LOG_DIR; // of the frame log
+    office_settings office;                    // sample period and depth of the history
+
+    int set(const std::string &key, const std::string &value);
+    int read_file(const std::string &path);
+    unsigned short get_udp_port() const { return udp_port ? udp_port : (unsigned short)(tcp_port + 1); }
+    void print(std::ostream &out) const;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "simd_kernels.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+#include <arm_neon.h>
+#endif
+
+static void merge(range_sums &sums, float min, float max, double sum, size_t count)
+{
+    if (!count)
+    {
+        return;
+    }
+    sums.min = sums.count ? std::min(sums.min, min) : min;
+    sums.max = sums.count ? std::max(sums.max, max) : max;
+    sums.sum += sum;
+    sums.count += count;
+}
+
+void accumulate_range_scalar(const float *values, size_t n, range_sums &sums)
+{
+    if (!n)
+    {
+        return;
+    }
+    float min = values[0], max = values[0];
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        min = std::min(min, values[i]);
+        max = std::max(max, values[i]);
+        sum += values[i];
+    }
+    merge(sums, min, max, sum, n);
+}
+
+double accumulate_squared_deviations_scalar(const float *values, size_t n, float mean)
+{
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++)
+    {
+        float deviation = values[i] - mean;
+        sum += deviation * deviation;
+    }
+    return sum;
+}
+
+#if defined(__SSE2__)
+
+void accumulate_range(const float *values, size_t n, range_sums &sums)
+{
+    if (n < 4)
+    {
+        accumulate_range_scalar(values, n, sums);
+        return;
+    }
+
+    __m128 min = _mm_loadu_ps(values);
+    __m128 max = min;
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 x = _mm_loadu_ps(&values[i]);
+        min = _mm_min_ps(min, x);
+        max = _mm_max_ps(max, x);
+        sum = _mm_add_ps(sum, x);
+    }
+
+    float lanes_min[4], lanes_max[4], lanes_sum[4];
+    _mm_storeu_ps(lanes_min, min);
+    _mm_storeu_ps(lanes_max, max);
+    _mm_storeu_ps(lanes_sum, sum);
+    merge(sums, std::min(std::min(lanes_min[0], lanes_min[1]), std::min(lanes_min[2], lanes_min[3])),
+          std::max(std::max(lanes_max[0], lanes_max[1]), std::max(lanes_max[2], lanes_max[3])),
+          (double)lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3], i);
+
+    accumulate_range_scalar(&values[i], n - i, sums); // tail
+}
+
+double accumulate_squared_deviations(const float *values, size_t n, float mean)
+{
+    __m128 m = _mm_set1_ps(mean);
+    __m128 sum = _mm_setzero_ps();
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        __m128 deviation = _mm_sub_ps(_mm_loadu_ps(&values[i]), m);
+        sum = _mm_add_ps(sum, _mm_mul_ps(deviation, deviation));
+    }
+
+    float lanes[4];
+    _mm_storeu_ps(lanes, sum);
+    return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3] + accumulate_squared_deviations_scalar(&values[i], n - i, mean);
+}
+
+#elif defined(__ARM_NEON) || defined(__ARM_NEON__)
+
+void accumulate_range(const float *values, size_t n, range_sums &sums)
+{
+    if (n < 4)
+    {
+        accumulate_range_scalar(values, n, sums);
+        return;
+    }
+
+    float32x4_t min = vld1q_f32(values);
+    float32x4_t max = min;
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t x = vld1q_f32(&values[i]);
+        min = vminq_f32(min, x);
+        max = vmaxq_f32(max, x);
+        sum = vaddq_f32(sum, x);
+    }
+
+    float lanes_min[4], lanes_max[4], lanes_sum[4];
+    vst1q_f32(lanes_min, min);
+    vst1q_f32(lanes_max, max);
+    vst1q_f32(lanes_sum, sum);
+    merge(sums, std::min(std::min(lanes_min[0], lanes_min[1]), std::min(lanes_min[2], lanes_min[3])),
+          std::max(std::max(lanes_max[0], lanes_max[1]), std::max(lanes_max[2], lanes_max[3])),
+          (double)lanes_sum[0] + lanes_sum[1] + lanes_sum[2] + lanes_sum[3], i);
+
+    accumulate_range_scalar(&values[i], n - i, sums); // tail
+}
+
+double accumulate_squared_deviations(const float *values, size_t n, float mean)
+{
+    float32x4_t m = vdupq_n_f32(mean);
+    float32x4_t sum = vdupq_n_f32(0.0f);
+    size_t i = 0;
+    for (; i + 4 <= n; i += 4)
+    {
+        float32x4_t deviation = vsubq_f32(vld1q_f32(&values[i]), m);
+        sum = vmlaq_f32(sum, deviation, deviation);
+    }
+
+    float lanes[4];
+    vst1q_f32(lanes, sum);
+    return (double)lanes[0] + lanes[1] + lanes[2] + lanes[3] + accumulate_squared_deviations_scalar(&values[i], n - i, mean);
+}
+
+#else
+
+void accumulate_range(const float *values, size_t n, range_sums &sums)
+{
+    accumulate_range_scalar(values, n, sums);
+}
+
+double accumulate_squared_deviations(const float *values, size_t n, float mean)
+{
+    return accumulate_squared_deviations_scalar(values, n, mean);
+}
+
+#endif
+
+series_stats stats_of(const float *first, size_t first_size, const float *second, size_t second_size)
+{
+    range_sums sums;
+    accumulate_range(first, first_size, sums);
+    accumulate_range(second, second_size, sums);
+
+    series_stats stats;
+    stats.count = sums.count;
+    if (!sums.count)
+    {
+        return stats;
+    }
+    stats.min = sums.min;
+    stats.max = sums.max;
+    stats.mean = sums.sum / sums.count;
+
+    double squares = accumulate_squared_deviations(first, first_size, (float)stats.mean) +
+                     accumulate_squared_deviations(second, second_size, (float)stats.mean);
+    stats.stddev = std::sqrt(squares / sums.count);
+    return stats;
+}
@@ -0,0 +1,47 @@
+#ifndef SIMD_KERNELS_HPP
+#define SIMD_KERNELS_HPP
+
+// /*
+// Vectorized reductions over arrays of floats: SSE2 on x86, NEON on the Raspberry Pi, plain loops elsewhere.
+// NEON needs __ARM_NEON: aarch64 always has it, a 32-bit (armhf) build only with the -mfpu of the Makefile
+// */
+
+#include <cstddef>
+
+/*
+ * Minimum, maximum and sum of a range - ranges can be merged, e.g. the two segments of a ring
+ */
+struct range_sums
+{
+    float min = 0.0;
+    float max = 0.0;
+    double sum = 0.0;
+    size_t count = 0;
+};
+
+/*
+ * Statistics of a series
+ */
+struct series_stats
+{
+    float min = 0.0;
+    float max = 0.0;
+    double mean = 0.0;
+    double stddev = 0.0; // of the population
+    size_t count = 0;
+};
+
+void accumulate_range(const float *values, size_t n, range_sums &sums);
+double accumulate_squared_deviations(const float *values, size_t n, float mean);
+
+// the same, without vector instructions - the reference of the benchmark
+void accumulate_range_scalar(const float *values, size_t n, range_sums &sums);
+double accumulate_squared_deviations_scalar(const float *values, size_t n, float mean);
+
+/*
+ * Statistics of a series held in up to two contiguous segments, in two passes: min/max/sum, then the squared
+ * deviations from the mean, which keeps the standard deviation accurate in float lanes
+ */
+series_stats stats_of(const float *first, size_t first_size, const float *second = nullptr, size_t second_size = 0);
+
+#endif
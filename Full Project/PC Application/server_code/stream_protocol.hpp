@@ -0,0 +1,218 @@
+#ifndef STREAM_PROTOCOL_HPP
+#define STREAM_PROTOCOL_HPP
+
+// /*
+// Binary datagrams sent by the UDP server, shared with the client (client_code/client.cpp)
+// */
+
+#include <cstdint>
+#include <cstring>
+
+/*
+ * Every datagram starts with a header of 8 bytes:
+ *
+ *   magic u8 | version u8 | kind u8 | count u8 | sequence u32
+ *
+ * The magic byte is not ASCII, so the client tells binary datagrams apart from the text responses by the first byte.
+ * Multi-byte fields are little-endian.
+ */
+#define STREAM_MAGIC 0xB5
+#define STREAM_VERSION 1
+#define STREAM_HEADER_BYTES 8
+#define STREAM_DATAGRAM_BYTES 1400 // fits in the ethernet MTU with the IP and UDP headers
+
+// kind 'S': real-time samples, each one is desk u8 | variable u8 | value f32 | ticks u32
+#define STREAM_KIND_SAMPLES 'S'
+#define STREAM_SAMPLE_BYTES 10
+#define STREAM_MAX_SAMPLES ((STREAM_DATAGRAM_BYTES - STREAM_HEADER_BYTES) / STREAM_SAMPLE_BYTES) // 139
+#define STREAM_FLUSH_TICKS 10                                                                   // a datagram is sent at least every 100 ms
+
+// kind 'B': part of a batched dump (last minute or history). The sequence of the header identifies the dump, count is 0
+// and a second header follows: order u8 | variable u8 | desk u8 | 0 u8 | part u16 | parts u16 | values u16 | 0 u16 | offset u32
+// then <values> f32, which are the values <offset> to <offset + values - 1> of the dump
+#define STREAM_KIND_BATCH 'B'
+#define STREAM_BATCH_HEADER_BYTES 16
+#define STREAM_BATCH_VALUES ((STREAM_DATAGRAM_BYTES - STREAM_HEADER_BYTES - STREAM_BATCH_HEADER_BYTES) / 4) // 344, a minute is 18 datagrams
+
+inline void put_u16(char *out, uint16_t value)
+{
+    out[0] = (char)(value & 0xFF);
+    out[1] = (char)((value >> 8) & 0xFF);
+}
+
+inline uint16_t get_u16(const char *in)
+{
+    return (uint16_t)((uint8_t)in[0] | ((uint8_t)in[1] << 8));
+}
+
+inline void put_u32(char *out, uint32_t value)
+{
+    out[0] = (char)(value & 0xFF);
+    out[1] = (char)((value >> 8) & 0xFF);
+    out[2] = (char)((value >> 16) & 0xFF);
+    out[3] = (char)((value >> 24) & 0xFF);
+}
+
+inline uint32_t get_u32(const char *in)
+{
+    return (uint32_t)(uint8_t)in[0] | ((uint32_t)(uint8_t)in[1] << 8) | ((uint32_t)(uint8_t)in[2] << 16) | ((uint32_t)(uint8_t)in[3] << 24);
+}
+
+inline void put_f32(char *out, float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    put_u32(out, bits);
+}
+
+inline float get_f32(const char *in)
+{
+    uint32_t bits = get_u32(in);
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+/*
+ * One sample of the real-time stream
+ */
+struct stream_sample
+{
+    uint8_t desk;
+    char variable; // 'l' or 'd'
+    float value;
+    uint32_t ticks; // sample periods since the server started
+};
+
+/*
+ * Datagram being filled with samples
+ */
+struct stream_datagram
+{
+    char bytes[STREAM_DATAGRAM_BYTES];
+    size_t size = 0;
+
+    void begin(char kind, uint32_t sequence)
+    {
+        bytes[0] = (char)STREAM_MAGIC;
+        bytes[1] = STREAM_VERSION;
+        bytes[2] = kind;
+        bytes[3] = 0;
+        put_u32(&bytes[4], sequence);
+        size = STREAM_HEADER_BYTES;
+    }
+
+    uint8_t count() const { return (uint8_t)bytes[3]; }
+    bool is_empty() const { return size <= STREAM_HEADER_BYTES; }
+    bool is_full() const { return count() >= STREAM_MAX_SAMPLES; }
+
+    void append(const stream_sample &sample)
+    {
+        char *out = &bytes[size];
+        out[0] = (char)sample.desk;
+        out[1] = sample.variable;
+        put_f32(&out[2], sample.value);
+        put_u32(&out[6], sample.ticks);
+        size += STREAM_SAMPLE_BYTES;
+        bytes[3]++;
+    }
+};
+
+/*
+ * Second header of a batched dump datagram
+ */
+struct batch_header
+{
+    char order;    // 'B' last minute or 'H' history
+    char variable; // 'l' or 'd'
+    uint8_t desk;
+    uint16_t part;  // 0 to parts - 1
+    uint16_t parts; // datagrams of the dump
+    uint16_t values;
+    uint32_t offset;
+};
+
+/*
+ * Writes one datagram of the dump <transfer> into out, which holds STREAM_DATAGRAM_BYTES, and returns its size
+ */
+inline size_t write_batch_datagram(char *out, uint32_t transfer, const batch_header &header, const float *values)
+{
+    out[0] = (char)STREAM_MAGIC;
+    out[1] = STREAM_VERSION;
+    out[2] = STREAM_KIND_BATCH;
+    out[3] = 0;
+    put_u32(&out[4], transfer);
+
+    char *batch = &out[STREAM_HEADER_BYTES];
+    batch[0] = header.order;
+    batch[1] = header.variable;
+    batch[2] = (char)header.desk;
+    batch[3] = 0;
+    put_u16(&batch[4], header.part);
+    put_u16(&batch[6], header.parts);
+    put_u16(&batch[8], header.values);
+    put_u16(&batch[10], 0);
+    put_u32(&batch[12], header.offset);
+
+    char *payload = &batch[STREAM_BATCH_HEADER_BYTES];
+    for (uint16_t i = 0; i < header.values; i++)
+    {
+        put_f32(&payload[4 * i], values[i]);
+    }
+    return STREAM_HEADER_BYTES + STREAM_BATCH_HEADER_BYTES + 4 * header.values;
+}
+
+/*
+ * Reads the second header of a batched dump datagram, whose common header was already validated
+ */
+inline bool read_batch_header(const char *data, size_t size, batch_header *header)
+{
+    if (size < STREAM_HEADER_BYTES + STREAM_BATCH_HEADER_BYTES)
+    {
+        return false;
+    }
+    const char *batch = &data[STREAM_HEADER_BYTES];
+    header->order = batch[0];
+    header->variable = batch[1];
+    header->desk = (uint8_t)batch[2];
+    header->part = get_u16(&batch[4]);
+    header->parts = get_u16(&batch[6]);
+    header->values = get_u16(&batch[8]);
+    header->offset = get_u32(&batch[12]);
+
+    return header->part < header->parts && header->values <= STREAM_BATCH_VALUES &&
+           size >= STREAM_HEADER_BYTES + STREAM_BATCH_HEADER_BYTES + 4 * (size_t)header->values;
+}
+
+inline float read_batch_value(const char *data, size_t index)
+{
+    return get_f32(&data[STREAM_HEADER_BYTES + STREAM_BATCH_HEADER_BYTES + 4 * index]);
+}
+
+/*
+ * Validates the header of a received datagram
+ */
+inline bool read_stream_header(const char *data, size_t size, char *kind, uint8_t *count, uint32_t *sequence)
+{
+    if (size < STREAM_HEADER_BYTES || (uint8_t)data[0] != STREAM_MAGIC || data[1] != STREAM_VERSION)
+    {
+        return false;
+    }
+    *kind = data[2];
+    *count = (uint8_t)data[3];
+    *sequence = get_u32(&data[4]);
+    return true;
+}
+
+inline stream_sample read_stream_sample(const char *data, size_t index)
+{
+    const char *in = &data[STREAM_HEADER_BYTES + index * STREAM_SAMPLE_BYTES];
+    stream_sample sample;
+    sample.desk = (uint8_t)in[0];
+    sample.variable = in[1];
+    sample.value = get_f32(&in[2]);
+    sample.ticks = get_u32(&in[6]);
+    return sample;
+}
+
+#endif
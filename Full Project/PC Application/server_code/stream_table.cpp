@@ -0,0 +1,116 @@
+#include "stream_table.hpp"
+
+#include <algorithm>
+
+stream_table::stream_table(int max_desks) : t_desks(max_desks), t_max_desks(max_desks)
+{
+}
+
+std::shared_ptr<desk_streams> stream_table::copy_desk(int address) const
+{
+    std::shared_ptr<const desk_streams> current = std::atomic_load(&t_desks[address - 1]);
+    return current ? std::make_shared<desk_streams>(*current) : std::make_shared<desk_streams>();
+}
+
+void stream_table::publish_desk(int address, const std::shared_ptr<desk_streams> &streams)
+{
+    std::shared_ptr<const desk_streams> published;
+    if (!streams->text.empty() || !streams->binary.empty())
+    {
+        published = streams;
+    }
+    std::atomic_store(&t_desks[address - 1], published);
+}
+
+/*
+ * Starts or stops the text stream of variable <type> of desk <address> to the client
+ * return whereas the stream has started 0, if it was stopped correctly 1 or not wrong command -1
+ */
+int stream_table::toggle_text(char type, int address, const boost::asio::ip::udp::endpoint &endpoint)
+{
+    if (address < 1 || address > t_max_desks)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    std::map<boost::asio::ip::udp::endpoint, std::pair<char, int>>::iterator owner = t_text_owners.find(endpoint);
+    if (owner != t_text_owners.end()) // stream is happening for this client
+    {
+        if (owner->second != std::make_pair(type, address))
+        {
+            return -1;
+        }
+
+        std::shared_ptr<desk_streams> streams = copy_desk(address);
+        streams->text.erase(std::remove(streams->text.begin(), streams->text.end(), std::make_pair(endpoint, type)), streams->text.end());
+        publish_desk(address, streams);
+        t_text_owners.erase(owner);
+        return 1; // stoped stream successfully
+    }
+
+    std::shared_ptr<desk_streams> streams = copy_desk(address);
+    streams->text.push_back(std::make_pair(endpoint, type));
+    publish_desk(address, streams);
+    t_text_owners[endpoint] = std::make_pair(type, address);
+    return 0;
+}
+
+/*
+ * Starts or stops the binary stream of variable <type> of desk <address> to the client
+ * return whereas the stream has started 0, if it was stopped correctly 1 or wrong command -1
+ */
+int stream_table::toggle_binary(char type, int address, const boost::asio::ip::udp::endpoint &endpoint)
+{
+    if ((type != 'l' && type != 'd') || address < 1 || address > t_max_desks)
+    {
+        return -1;
+    }
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    // finds the client
+    std::shared_ptr<const binary_list> all = std::atomic_load(&t_binary);
+    std::shared_ptr<binary_subscriber> subscriber;
+    for (size_t i = 0; all && i < all->size(); i++)
+    {
+        if ((*all)[i]->endpoint == endpoint)
+        {
+            subscriber = (*all)[i];
+        }
+    }
+
+    std::shared_ptr<desk_streams> streams = copy_desk(address);
+    std::pair<std::shared_ptr<binary_subscriber>, char> entry = std::make_pair(subscriber, type);
+    std::vector<std::pair<std::shared_ptr<binary_subscriber>, char>>::iterator found = std::find(streams->binary.begin(), streams->binary.end(), entry);
+
+    if (subscriber && found != streams->binary.end()) // stops
+    {
+        streams->binary.erase(found);
+        publish_desk(address, streams);
+
+        if (--subscriber->n_variables == 0) // the client leaves once it does not follow any variable
+        {
+            std::shared_ptr<binary_list> remaining = std::make_shared<binary_list>(*all);
+            remaining->erase(std::remove(remaining->begin(), remaining->end(), subscriber), remaining->end());
+            std::atomic_store(&t_binary, remaining->empty() ? std::shared_ptr<const binary_list>() : std::shared_ptr<const binary_list>(remaining));
+        }
+        return 1;
+    }
+
+    if (!subscriber) // new client
+    {
+        subscriber = std::make_shared<binary_subscriber>();
+        subscriber->endpoint = endpoint;
+        subscriber->pending = std::make_shared<stream_datagram>();
+        subscriber->pending->begin(STREAM_KIND_SAMPLES, subscriber->sequence);
+
+        std::shared_ptr<binary_list> extended = all ? std::make_shared<binary_list>(*all) : std::make_shared<binary_list>();
+        extended->push_back(subscriber);
+        std::atomic_store(&t_binary, std::shared_ptr<const binary_list>(extended));
+    }
+
+    subscriber->n_variables++;
+    streams->binary.push_back(std::make_pair(subscriber, type));
+    publish_desk(address, streams);
+    return 0;
+}
@@ -0,0 +1,67 @@
+#ifndef STREAM_TABLE_HPP
+#define STREAM_TABLE_HPP
+
+#include <iostream>
+#include <vector>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <boost/asio.hpp>
+
+#include "stream_protocol.hpp"
+
+/*
+ * Client of the binary stream, it may follow several variables of several desks
+ */
+struct binary_subscriber
+{
+    boost::asio::ip::udp::endpoint endpoint;
+    int n_variables = 0; // followed variables - only the stream_table changes it
+
+    // only the ingest touches them
+    std::shared_ptr<stream_datagram> pending;
+    uint32_t sequence = 0;
+};
+
+/*
+ * Fan-out list of one desk
+ */
+struct desk_streams
+{
+    std::vector<std::pair<boost::asio::ip::udp::endpoint, char>> text;            // text stream clients and their variable
+    std::vector<std::pair<std::shared_ptr<binary_subscriber>, char>> binary; // binary stream clients and one of their variables
+};
+
+typedef std::vector<std::shared_ptr<binary_subscriber>> binary_list;
+
+/*
+ * Subscribers of the UDP streams, indexed by desk.
+ *
+ * The lists are copy-on-write: a (rare) subscription copies the list of its desk, changes the copy and publishes it,
+ * while the ingest only loads the list of the desk that produced the sample, without any lock of the table.
+ */
+class stream_table
+{
+
+private: // this things are private
+    std::vector<std::shared_ptr<const desk_streams>> t_desks; // (address - 1), nullptr when nobody follows the desk
+    std::shared_ptr<const binary_list> t_binary;               // every binary subscriber, to flush their datagrams
+    std::map<boost::asio::ip::udp::endpoint, std::pair<char, int>> t_text_owners; // a client has one text stream at a time
+    const int t_max_desks = 0;
+
+    std::mutex t_mutex; // serializes the subscriptions
+
+    std::shared_ptr<desk_streams> copy_desk(int address) const;
+    void publish_desk(int address, const std::shared_ptr<desk_streams> &streams);
+
+public: // this things are public
+    stream_table(int max_desks);
+
+    int toggle_text(char type, int address, const boost::asio::ip::udp::endpoint &endpoint);
+    int toggle_binary(char type, int address, const boost::asio::ip::udp::endpoint &endpoint);
+
+    std::shared_ptr<const desk_streams> desk(int address) const { return std::atomic_load(&t_desks[address - 1]); }
+    std::shared_ptr<const binary_list> binary_subscribers() const { return std::atomic_load(&t_binary); }
+};
+
+#endif
@@ -0,0 +1,176 @@
+#include "subscription_table.hpp"
+#include "database.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+/* --------------------------------------------------------------------------------
+   |                                Subscriber                                    |
+   -------------------------------------------------------------------------------- */
+
+/*
+ * Follows <type> of desk <desk>, or changes the threshold and the tag when it is already followed
+ * returns 1, or -1 when the client follows too many values
+ */
+int metric_subscriber::watch(int desk, char type, float threshold, int64_t tag)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    for (size_t i = 0; i < t_watches.size(); i++)
+    {
+        if (t_watches[i].desk == desk && t_watches[i].type == type)
+        {
+            t_watches[i].threshold = threshold;
+            t_watches[i].tag = tag;
+            return 1;
+        }
+    }
+    if (t_watches.size() == SUBSCRIPTION_MAX_WATCHES)
+    {
+        return -1;
+    }
+
+    metric_watch watch;
+    watch.desk = desk;
+    watch.type = type;
+    watch.threshold = threshold;
+    watch.tag = tag;
+    t_watches.push_back(watch);
+    return 1;
+}
+
+/*
+ * Stops following <type> of desk <desk>, with the change still waiting
+ * returns 1, or -1 when it was not followed
+ */
+int metric_subscriber::unwatch(int desk, char type)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    for (size_t i = 0; i < t_watches.size(); i++)
+    {
+        if (t_watches[i].desk == desk && t_watches[i].type == type)
+        {
+            if (t_watches[i].delta >= 0)
+            {
+                t_deltas[t_watches[i].delta].type = 0; // taken but not sent
+            }
+            t_watches[i] = t_watches.back();
+            t_watches.pop_back();
+            return 1;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Stops following everything, e.g. when the client leaves
+ */
+void metric_subscriber::clear()
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    t_watches.clear();
+    t_deltas.clear();
+}
+
+bool metric_subscriber::empty() const
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    return t_watches.empty();
+}
+
+/*
+ * Keeps the followed values that moved more than their threshold since they were last sent - only the ingest calls it
+ */
+void metric_subscriber::publish(const desk_columns &columns, const performance_metrics &totals)
+{
+    bool first_change = false;
+    {
+        std::lock_guard<std::mutex> lock(t_mutex);
+
+        bool waiting = !t_deltas.empty();
+        for (size_t i = 0; i < t_watches.size(); i++)
+        {
+            metric_watch &watch = t_watches[i];
+            float value;
+            if (watch.desk == 0)
+            {
+                value = watch.type == 'e' ? totals.energy : watch.type == 'p' ? totals.power : watch.type == 'v' ? totals.visibility : totals.flicker;
+            }
+            else
+            {
+                value = columns.column(watch.type)[watch.desk - 1];
+            }
+
+            if (watch.primed && std::fabs(value - watch.sent) <= watch.threshold)
+            {
+                continue;
+            }
+            watch.sent = value;
+            watch.primed = true;
+            if (watch.delta < 0)
+            {
+                watch.delta = (int)t_deltas.size();
+                t_deltas.push_back(metric_delta{watch.desk, watch.type, value, watch.tag});
+            }
+            else
+            {
+                t_deltas[watch.delta].value = value; // coalesced, the client did not take the previous one yet
+            }
+        }
+        first_change = !waiting && !t_deltas.empty();
+    }
+
+    if (first_change && on_changed)
+    {
+        on_changed();
+    }
+}
+
+/*
+ * Moves the changes waiting into <deltas>, whose memory is reused by the next ones
+ */
+void metric_subscriber::take(std::vector<metric_delta> &deltas)
+{
+    deltas.clear();
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    std::swap(deltas, t_deltas);
+    for (size_t i = 0; i < t_watches.size(); i++)
+    {
+        t_watches[i].delta = -1;
+    }
+    deltas.erase(std::remove_if(deltas.begin(), deltas.end(), [](const metric_delta &delta) { return delta.type == 0; }), deltas.end());
+}
+
+/* --------------------------------------------------------------------------------
+   |                                  Table                                       |
+   -------------------------------------------------------------------------------- */
+
+void subscription_table::add(metric_subscriber *subscriber)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    std::shared_ptr<const std::vector<metric_subscriber *>> current = std::atomic_load(&t_subscribers);
+    if (current && std::find(current->begin(), current->end(), subscriber) != current->end())
+    {
+        return;
+    }
+    std::shared_ptr<std::vector<metric_subscriber *>> list = current ? std::make_shared<std::vector<metric_subscriber *>>(*current) : std::make_shared<std::vector<metric_subscriber *>>();
+    list->push_back(subscriber);
+    std::atomic_store(&t_subscribers, std::shared_ptr<const std::vector<metric_subscriber *>>(list));
+}
+
+void subscription_table::remove(metric_subscriber *subscriber)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    std::shared_ptr<const std::vector<metric_subscriber *>> current = std::atomic_load(&t_subscribers);
+    if (!current || std::find(current->begin(), current->end(), subscriber) == current->end())
+    {
+        return;
+    }
+    std::shared_ptr<std::vector<metric_subscriber *>> list = std::make_shared<std::vector<metric_subscriber *>>(*current);
+    list->erase(std::remove(list->begin(), list->end(), subscriber), list->end());
+    std::atomic_store(&t_subscribers, list->empty() ? std::shared_ptr<const std::vector<metric_subscriber *>>() : std::shared_ptr<const std::vector<metric_subscriber *>>(list));
+}
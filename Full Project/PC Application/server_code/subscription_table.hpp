@@ -0,0 +1,91 @@
+#ifndef SUBSCRIPTION_TABLE_HPP
+#define SUBSCRIPTION_TABLE_HPP
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <functional>
+#include <cstdint>
+
+#define PUBLISH_HZ 20                // publications of the changes per second, at most
+#define SUBSCRIPTION_MAX_WATCHES 2560 // values followed by one client: every column of every desk, and the totals
+
+struct desk_columns;
+struct performance_metrics;
+
+/*
+ * Value followed by a client: <type> of desk <desk>, or of the whole system when <desk> is 0
+ */
+struct metric_watch
+{
+    int desk = 0;
+    char type = 0;
+    float threshold = 0.0; // smaller changes are not sent
+    int64_t tag = -1;      // of the command that started it, -1 none
+    float sent = 0.0;      // last value handed to the client
+    bool primed = false;   // the first value is always sent
+    int delta = -1;        // its change in t_deltas, -1 none
+};
+
+/*
+ * Change of a followed value, waiting to be sent
+ */
+struct metric_delta
+{
+    int desk;
+    char type;
+    float value;
+    int64_t tag;
+};
+
+/*
+ * Values followed by one TCP client - it is owned by the connection.
+ *
+ * At each publication the ingest compares them with what the client was last sent and keeps the ones that changed
+ * by more than their threshold. A value that changes again before the connection takes it is overwritten, so a slow
+ * client gets the newest values and never a backlog. The owner is told through on_changed when there is something
+ * to take, so nobody polls.
+ */
+class metric_subscriber
+{
+
+private: // this things are private
+    std::vector<metric_watch> t_watches;
+    std::vector<metric_delta> t_deltas;
+
+    mutable std::mutex t_mutex; // the connection edits the watches and takes the changes, the ingest publishes
+
+public: // this things are public
+    std::function<void()> on_changed; // called, without the lock, when the first change waits to be taken
+
+    int watch(int desk, char type, float threshold, int64_t tag);
+    int unwatch(int desk, char type);
+    void clear();
+    bool empty() const;
+    void publish(const desk_columns &columns, const performance_metrics &totals);
+    void take(std::vector<metric_delta> &deltas);
+};
+
+/*
+ * Clients that follow some value, the ingest goes through them at each publication.
+ *
+ * The list is copy-on-write like the lists of the stream_table: a (rare) subscription copies it, while the ingest only
+ * loads it.
+ */
+class subscription_table
+{
+
+private: // this things are private
+    std::shared_ptr<const std::vector<metric_subscriber *>> t_subscribers;
+
+    std::mutex t_mutex; // serializes the subscriptions
+
+public: // this things are public
+    void add(metric_subscriber *subscriber);
+    void remove(metric_subscriber *subscriber);
+
+    std::shared_ptr<const std::vector<metric_subscriber *>> subscribers() const { return std::atomic_load(&t_subscribers); }
+};
+
+#endif
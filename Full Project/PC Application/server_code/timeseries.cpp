@@ -0,0 +1,362 @@
+#include "timeseries.hpp"
+
+#include <cstring>
+
+#define WORST_SAMPLE_BITS 80 // 4 + 32 bits of timestamp and 2 + 5 + 5 + 32 bits of value
+
+/*
+ * Writes the n less significative bits of value, the most significative first
+ */
+static void write_bits(uint8_t *data, uint32_t &pos, uint64_t value, unsigned n)
+{
+    while (n)
+    {
+        unsigned free_bits = 8 - (pos & 7);
+        unsigned take = n < free_bits ? n : free_bits;
+        uint8_t bits = (uint8_t)((value >> (n - take)) & ((1u << take) - 1));
+
+        data[pos >> 3] |= (uint8_t)(bits << (free_bits - take));
+        pos += take;
+        n -= take;
+    }
+}
+
+static uint64_t read_bits(const uint8_t *data, uint32_t &pos, unsigned n)
+{
+    uint64_t value = 0;
+    while (n)
+    {
+        unsigned left_bits = 8 - (pos & 7);
+        unsigned take = n < left_bits ? n : left_bits;
+        uint8_t bits = (uint8_t)((data[pos >> 3] >> (left_bits - take)) & ((1u << take) - 1));
+
+        value = (value << take) | bits;
+        pos += take;
+        n -= take;
+    }
+    return value;
+}
+
+static uint32_t float_bits(float value)
+{
+    uint32_t bits;
+    std::memcpy(&bits, &value, sizeof(bits));
+    return bits;
+}
+
+static float bits_float(uint32_t bits)
+{
+    float value;
+    std::memcpy(&value, &bits, sizeof(value));
+    return value;
+}
+
+static unsigned leading_zeros(uint32_t x) { return x ? __builtin_clz(x) : 32; }
+static unsigned trailing_zeros(uint32_t x) { return x ? __builtin_ctz(x) : 32; }
+
+/* --------------------------------------------------------------------------------
+   |                                  Block                                       |
+   -------------------------------------------------------------------------------- */
+
+void history_block::reset()
+{
+    first_tick = last_tick = first_value = 0;
+    count = n_bits = 0;
+    last_delta = 0;
+    last_value = 0;
+    leading = 0xFF;
+    trailing = 0;
+    std::memset(data, 0, sizeof(data));
+}
+
+bool history_block::append(uint32_t tick, float value)
+{
+    uint32_t bits = float_bits(value);
+
+    if (count == 0) // the first sample is kept raw
+    {
+        first_tick = last_tick = tick;
+        first_value = last_value = bits;
+        count = 1;
+        return true;
+    }
+
+    if (n_bits + WORST_SAMPLE_BITS > 8 * HISTORY_BLOCK_BYTES)
+    {
+        return false;
+    } // block is full
+
+    // timestamp: delta of delta
+    int32_t delta = (int32_t)(tick - last_tick);
+    int32_t dod = delta - last_delta;
+
+    if (dod == 0)
+    {
+        write_bits(data, n_bits, 0x0, 1);
+    }
+    else if (dod >= -64 && dod <= 63)
+    {
+        write_bits(data, n_bits, 0x2, 2);
+        write_bits(data, n_bits, (uint32_t)dod, 7);
+    }
+    else if (dod >= -256 && dod <= 255)
+    {
+        write_bits(data, n_bits, 0x6, 3);
+        write_bits(data, n_bits, (uint32_t)dod, 9);
+    }
+    else if (dod >= -2048 && dod <= 2047)
+    {
+        write_bits(data, n_bits, 0xE, 4);
+        write_bits(data, n_bits, (uint32_t)dod, 12);
+    }
+    else
+    {
+        write_bits(data, n_bits, 0xF, 4);
+        write_bits(data, n_bits, (uint32_t)dod, 32);
+    }
+
+    // value: XOR with the previous one
+    uint32_t xored = bits ^ last_value;
+
+    if (xored == 0)
+    {
+        write_bits(data, n_bits, 0x0, 1);
+    }
+    else
+    {
+        unsigned lead = leading_zeros(xored);
+        unsigned trail = trailing_zeros(xored);
+        lead = lead > 31 ? 31 : lead; // has to fit in 5 bits
+
+        if (leading != 0xFF && lead >= leading && trail >= trailing) // fits in the previous window
+        {
+            unsigned meaningful = 32 - leading - trailing;
+            write_bits(data, n_bits, 0x2, 2);
+            write_bits(data, n_bits, xored >> trailing, meaningful);
+        }
+        else
+        {
+            unsigned meaningful = 32 - lead - trail;
+            write_bits(data, n_bits, 0x3, 2);
+            write_bits(data, n_bits, lead, 5);
+            write_bits(data, n_bits, meaningful - 1, 5); // 1 to 32 meaningful bits
+            write_bits(data, n_bits, xored >> trail, meaningful);
+            leading = (uint8_t)lead;
+            trailing = (uint8_t)trail;
+        }
+    }
+
+    last_delta = delta;
+    last_tick = tick;
+    last_value = bits;
+    count++;
+    return true;
+}
+
+static int32_t sign_extend(uint64_t value, unsigned n)
+{
+    uint32_t mask = 1u << (n - 1);
+    uint32_t v = (uint32_t)value;
+    return (int32_t)((v ^ mask) - mask);
+}
+
+size_t history_block::decode(uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks) const
+{
+    if (count == 0 || last_tick < from || first_tick > to)
+    {
+        return 0;
+    } // nothing in the range
+
+    size_t n_out = 0;
+    uint32_t pos = 0;
+    uint32_t tick = first_tick;
+    uint32_t bits = first_value;
+    int32_t delta = 0;
+    unsigned lead = 0;
+    unsigned trail = 0;
+
+    for (uint32_t i = 0; i < count; i++)
+    {
+        if (i > 0)
+        {
+            int32_t dod = 0;
+            if (read_bits(data, pos, 1) == 0)
+            {
+                dod = 0;
+            }
+            else if (read_bits(data, pos, 1) == 0)
+            {
+                dod = sign_extend(read_bits(data, pos, 7), 7);
+            }
+            else if (read_bits(data, pos, 1) == 0)
+            {
+                dod = sign_extend(read_bits(data, pos, 9), 9);
+            }
+            else if (read_bits(data, pos, 1) == 0)
+            {
+                dod = sign_extend(read_bits(data, pos, 12), 12);
+            }
+            else
+            {
+                dod = (int32_t)read_bits(data, pos, 32);
+            }
+            delta += dod;
+            tick += delta;
+
+            if (read_bits(data, pos, 1) == 1)
+            {
+                if (read_bits(data, pos, 1) == 1) // new window
+                {
+                    lead = (unsigned)read_bits(data, pos, 5);
+                    unsigned meaningful = (unsigned)read_bits(data, pos, 5) + 1;
+                    trail = 32 - lead - meaningful;
+                }
+                bits ^= (uint32_t)(read_bits(data, pos, 32 - lead - trail) << trail);
+            }
+        }
+
+        if (tick > to)
+        {
+            break;
+        }
+        if (tick >= from)
+        {
+            values.push_back(bits_float(bits));
+            if (ticks)
+            {
+                ticks->push_back(tick);
+            }
+            n_out++;
+        }
+    }
+    return n_out;
+}
+
+/* --------------------------------------------------------------------------------
+   |                                  Series                                      |
+   -------------------------------------------------------------------------------- */
+
+void compressed_series::append(uint32_t tick, float value)
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+
+    if (!t_blocks.empty() && newest().append(tick, value))
+    {
+        return;
+    }
+
+    // the newest block is full: allocates a new one until the limit, then recycles the oldest
+    if (t_blocks.size() < t_max_blocks)
+    {
+        t_blocks.push_back(std::unique_ptr<history_block>(new history_block)); // the ring only recycles once it stops growing
+    }
+    else
+    {
+        t_oldest = (t_oldest + 1) % t_blocks.size();
+    }
+
+    history_block &block = newest();
+    block.reset();
+    block.append(tick, value);
+}
+
+/*
+ * Scans the contiguous compressed blocks that overlap [from, to]. They are copied under the lock and decoded outside it,
+ * so a long query never stalls the ingest.
+ */
+size_t compressed_series::query(uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks) const
+{
+    std::vector<history_block> overlapping;
+    {
+        std::lock_guard<std::mutex> lock(t_mutex);
+
+        for (size_t i = 0; i < t_blocks.size(); i++)
+        {
+            const history_block &block = *t_blocks[(t_oldest + i) % t_blocks.size()];
+            if (block.count && block.last_tick >= from && block.first_tick <= to)
+            {
+                overlapping.push_back(block);
+            }
+        }
+    }
+
+    size_t n_out = 0;
+    for (size_t i = 0; i < overlapping.size(); i++)
+    {
+        n_out += overlapping[i].decode(from, to, values, ticks);
+    }
+    return n_out;
+}
+
+void compressed_series::clear()
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    t_blocks.clear();
+    t_oldest = 0;
+}
+
+size_t compressed_series::memory_bytes() const
+{
+    std::lock_guard<std::mutex> lock(t_mutex);
+    return t_blocks.size() * sizeof(history_block);
+}
+
+/* --------------------------------------------------------------------------------
+   |                                  Store                                       |
+   -------------------------------------------------------------------------------- */
+
+history_store::history_store(int max_desks, size_t max_blocks) : t_max_desks(max_desks)
+{
+    // every column exists from the start, only their blocks are allocated on demand
+    for (int i = 0; i < t_max_desks * HISTORY_VARIABLES; i++)
+    {
+        t_series.push_back(std::unique_ptr<compressed_series>(new compressed_series{max_blocks}));
+    }
+}
+
+compressed_series *history_store::series(int desk, char variable) const
+{
+    if (desk < 1 || desk > t_max_desks)
+    {
+        return nullptr;
+    }
+    int column = variable == 'l' ? 0 : variable == 'd' ? 1 : -1;
+    if (column < 0)
+    {
+        return nullptr;
+    }
+    return t_series[(desk - 1) * HISTORY_VARIABLES + column].get();
+}
+
+void history_store::append(int desk, char variable, uint32_t tick, float value)
+{
+    compressed_series *column = series(desk, variable);
+    if (column)
+    {
+        column->append(tick, value);
+    }
+}
+
+size_t history_store::query(int desk, char variable, uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks) const
+{
+    compressed_series *column = series(desk, variable);
+    return column ? column->query(from, to, values, ticks) : 0;
+}
+
+void history_store::clear()
+{
+    for (size_t i = 0; i < t_series.size(); i++)
+    {
+        t_series[i]->clear();
+    }
+}
+
+size_t history_store::memory_bytes() const
+{
+    size_t bytes = 0;
+    for (size_t i = 0; i < t_series.size(); i++)
+    {
+        bytes += t_series[i]->memory_bytes();
+    }
+    return bytes;
+}
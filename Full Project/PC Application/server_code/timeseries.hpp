@@ -0,0 +1,89 @@
+#ifndef TIMESERIES_HPP
+#define TIMESERIES_HPP
+
+#include <iostream>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <cstdint>
+
+#define HISTORY_BLOCK_BYTES 1024 // compressed payload of each block
+#define HISTORY_MAX_BLOCKS 1024  // blocks kept per (desk, variable) - the oldest block is recycled when it is full
+#define HISTORY_VARIABLES 2      // 'l' luminance and 'd' duty cicle
+
+/*
+ * Fixed-size block of a compressed series (Gorilla-style).
+ *
+ * The first sample is kept raw in the header. The following timestamps are written as a delta-of-delta,
+ * which costs a single bit for a steady sample rate, and the values as the XOR with the previous value,
+ * which costs one bit for a repeated value and only the meaningful bits otherwise.
+ */
+struct history_block
+{
+    uint32_t first_tick = 0;
+    uint32_t last_tick = 0;
+    uint32_t first_value = 0; // raw bits of the first float
+    uint32_t count = 0;
+    uint32_t n_bits = 0;
+
+    // encoder state
+    int32_t last_delta = 0;
+    uint32_t last_value = 0;
+    uint8_t leading = 0xFF; // 0xFF: there is no previous meaningful window
+    uint8_t trailing = 0;
+
+    uint8_t data[HISTORY_BLOCK_BYTES];
+
+    void reset();
+    bool append(uint32_t tick, float value); // false when the block is full
+
+    // decodes every sample of the block in [from, to] and returns how many were appended to values
+    size_t decode(uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks) const;
+};
+
+/*
+ * Compressed history of one variable of one desk
+ */
+class compressed_series
+{
+
+private: // this things are private
+    std::vector<std::unique_ptr<history_block>> t_blocks; // used as a ring of blocks
+    size_t t_oldest = 0;                                  // index of the oldest block
+    const size_t t_max_blocks = 0;
+
+    mutable std::mutex t_mutex;
+
+    history_block &newest() { return *t_blocks[(t_oldest + t_blocks.size() - 1) % t_blocks.size()]; }
+
+public: // this things are public
+    compressed_series(size_t max_blocks) : t_max_blocks(max_blocks) {}
+
+    void append(uint32_t tick, float value);
+    size_t query(uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks = nullptr) const;
+    void clear();
+    size_t memory_bytes() const;
+};
+
+/*
+ * Columnar store keyed by (desk, variable, tick): one compressed series per column
+ */
+class history_store
+{
+
+private: // this things are private
+    std::vector<std::unique_ptr<compressed_series>> t_series; // (desk - 1) * HISTORY_VARIABLES + variable
+    const int t_max_desks = 0;
+
+    compressed_series *series(int desk, char variable) const;
+
+public: // this things are public
+    history_store(int max_desks, size_t max_blocks = HISTORY_MAX_BLOCKS);
+
+    void append(int desk, char variable, uint32_t tick, float value);
+    size_t query(int desk, char variable, uint32_t from, uint32_t to, std::vector<float> &values, std::vector<uint32_t> *ticks = nullptr) const;
+    void clear();
+    size_t memory_bytes() const;
+};
+
+#endif
@@ -0,0 +1,90 @@
+#include "window_metrics.hpp"
+
+#include <cmath>
+#include <algorithm>
+
+void metric_window::cumulative::store(const window_sums &sums)
+{
+    energy.store(sums.energy, std::memory_order_relaxed);
+    power.store(sums.power, std::memory_order_relaxed);
+    visibility.store(sums.visibility, std::memory_order_relaxed);
+    flicker.store(sums.flicker, std::memory_order_relaxed);
+    samples.store(sums.samples, std::memory_order_release);
+}
+
+window_sums metric_window::cumulative::load() const
+{
+    window_sums sums;
+    sums.samples = samples.load(std::memory_order_acquire);
+    sums.energy = energy.load(std::memory_order_relaxed);
+    sums.power = power.load(std::memory_order_relaxed);
+    sums.visibility = visibility.load(std::memory_order_relaxed);
+    sums.flicker = flicker.load(std::memory_order_relaxed);
+    return sums;
+}
+
+metric_window::metric_window(size_t max_seconds, uint32_t bucket_samples) : t_ring_size(max_seconds + 2),
+                                                                           t_bucket_samples(std::max<uint32_t>(bucket_samples, 1)),
+                                                                           t_ring(new cumulative[max_seconds + 2])
+{
+}
+
+/*
+ * Adds the contribution of one sample of the desk
+ */
+void metric_window::add(double energy, double power, double visibility, double flicker)
+{
+    t_sums.energy += energy;
+    t_sums.power += power;
+    t_sums.visibility += visibility;
+    t_sums.flicker += flicker;
+    t_sums.samples++;
+    t_now.store(t_sums);
+
+    if (t_sums.samples % t_bucket_samples == 0) // end of a second
+    {
+        uint64_t seconds = t_seconds.load(std::memory_order_relaxed) + 1;
+        t_ring[seconds % t_ring_size].store(t_sums);
+        t_seconds.store(seconds, std::memory_order_release);
+    }
+}
+
+/*
+ * Forgets every sample, keeping the ring: the slots of the seconds before the reset are never read again, each one
+ * is written before the window reaches it
+ */
+void metric_window::reset()
+{
+    t_seconds.store(0, std::memory_order_release); // the queries answer with t_now from here on
+    t_sums = window_sums();
+    t_now.store(t_sums);
+}
+
+/*
+ * Sums of the metrics in the last <seconds>, or since the desk started when it is younger than that.
+ * <seconds> is clamped to [0, the longest window] before the cast, and one that is not a number reads nothing
+ */
+window_sums metric_window::query(float seconds) const
+{
+    if (!std::isfinite(seconds))
+    {
+        return window_sums();
+    }
+
+    uint64_t completed = t_seconds.load(std::memory_order_acquire);
+    uint64_t span = (uint64_t)std::min<double>(std::ceil(std::max(seconds, 0.0f)), (double)(t_ring_size - 2));
+
+    window_sums sums = t_now.load();
+    if (span >= completed) // the whole life of the desk
+    {
+        return sums;
+    }
+
+    window_sums evicted = t_ring[(completed - span) % t_ring_size].load();
+    sums.energy -= evicted.energy;
+    sums.power -= evicted.power;
+    sums.visibility -= evicted.visibility;
+    sums.flicker -= evicted.flicker;
+    sums.samples -= evicted.samples;
+    return sums;
+}
@@ -0,0 +1,65 @@
+#ifndef WINDOW_METRICS_HPP
+#define WINDOW_METRICS_HPP
+
+#include <iostream>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+
+#define WINDOW_BUCKET_SAMPLES 100 // one second of samples of a desk, by default
+#define WINDOW_MAX_SECONDS 3600   // longest window that can be asked for, by default
+
+/*
+ * Sums of the metrics of a desk over a window, and the number of samples they add up
+ */
+struct window_sums
+{
+    double energy = 0.0;     // J consumed
+    double power = 0.0;      // sum of the instantaneous power of each sample
+    double visibility = 0.0; // sum of the visibility error of each sample
+    double flicker = 0.0;    // flicker error accumulated
+    uint64_t samples = 0;
+};
+
+/*
+ * Metrics of one desk over the last <seconds>, for any window up to its longest one (WINDOW_MAX_SECONDS by default).
+ *
+ * The desk keeps running sums of its metrics and, at the end of every second, stores them in a ring. The sums over
+ * a window are the running sums minus the ones stored <seconds> ago (subtract-on-evict), so a sample costs O(1) and
+ * a query O(1) for any window, and the raw samples are never read again. The window has a resolution of one second:
+ * it covers the whole seconds asked for plus the samples of the current one.
+ *
+ * Only the ingest adds samples, any thread queries.
+ */
+class metric_window
+{
+
+private: // this things are private
+    struct cumulative
+    {
+        std::atomic<double> energy{0.0};
+        std::atomic<double> power{0.0};
+        std::atomic<double> visibility{0.0};
+        std::atomic<double> flicker{0.0};
+        std::atomic<uint64_t> samples{0};
+
+        void store(const window_sums &sums);
+        window_sums load() const;
+    };
+
+    const size_t t_ring_size;                          // the longest window + 2: the slot being written is never read
+    const uint32_t t_bucket_samples;                   // samples of a desk in one second
+    std::unique_ptr<cumulative[]> t_ring;              // running sums at the end of each second, (second % size)
+    cumulative t_now;                                  // running sums, published for the readers
+    window_sums t_sums;                                // running sums - only the ingest touches it
+    std::atomic<uint64_t> t_seconds{0};                // seconds completed
+
+public: // this things are public
+    metric_window(size_t max_seconds = WINDOW_MAX_SECONDS, uint32_t bucket_samples = WINDOW_BUCKET_SAMPLES);
+
+    void add(double energy, double power, double visibility, double flicker);
+    void reset();
+    window_sums query(float seconds) const;
+};
+
+#endif
@@ -1,4 +1,5 @@
 #include "controller.h"
+#include "fixed_point.hpp"
 #include <SPI.h>
 #include <mcp2515.h>
 #include "can_buffer.cpp"
@@ -1073,22 +1074,7 @@ void hub()
  //if flag = true: The converted float is returned(for canbus msgs), if flag=false: writes to serial(for hub msgs)
 byte* float_2_bytes(float fnum, bool flag)
 {   
-    // the maximum admissive value is 4095.94(9)
-    fnum = fnum < pow(2,12)-0.05 ? fnum : pow(2,12)-1+0.9;  // 2^12-1 == 4095, 12 bits representation + 4bits to decimal representation(0.1 -> 0.9)
-  
-    uint16_t output = fnum < 0; // flag that represents if fnum is negative
-    uint16_t inum = fnum;  // integer part
-    fnum = fnum-inum; // floating part
-    uint8_t dnum = round(10*fnum);  // integer decimal part
-
-    // increments one when the decimal part rounds up
-    if(dnum == 10){
-        dnum = 0;
-        inum++;
-    }
-    
-    inum = inum<<4; // the integer will be represented in the first 1,5 bits
-    output = output ? 15: inum + dnum; // send 15 when fnum is negative, which should not be possible
+    uint16_t output = fixed_12_4_encode(fnum); // see fixed_point.hpp
 
     if(flag) {
       byte* number = (byte*)malloc(2*sizeof(byte));
@@ -1125,42 +1111,14 @@ void send_time()
 }
 
 float bytes2float(byte * myBytes){
-  float welit = 0;
-  byte mask_decimal = B00001111;
-  byte mask_int = B11110000;
-  // get decimal part of the number
-  byte decimal = myBytes[1] & mask_decimal;
-  int decimal_int = decimal;
-
-  // get decimal part of the number
-  byte split_int = (myBytes[1] & mask_int) >> 4;
-  int integer = (myBytes[0] << 4) + split_int;
-
-  welit = integer + decimal_int/10.0;
-  
-  return welit;
+  return fixed_12_4_decode(fixed_12_4_from_bytes(myBytes[0], myBytes[1]));
 }
 
 
 //Same conversion function, but for consensus we need 2 decimal cases, max number is 511.99, 9 bits for int and 7 for floating point
 byte* float_2_bytes_2decimals(float fnum)
 {   
-    // the maximum admissive value is 511.99
-    fnum = fnum < pow(2,9)-0.005 ? fnum : pow(2,9)-1+0.99;  // 2^12-1 == 4095, 12 bits representation + 4bits to decimal representation(0.1 -> 0.9)
-  
-    uint16_t output = fnum < 0; // flag that represents if fnum is negative
-    uint16_t inum = fnum;  // integer part
-    fnum = fnum-inum; // floating part
-    uint8_t dnum = round(100*fnum);  // integer decimal part
-
-    // increments one when the decimal part rounds up
-    if(dnum == 100){
-        dnum = 0;
-        inum++;
-    }
-    
-    inum = inum<<7; // the float will be represented in the first 1,8 bits
-    output = output ? 127: inum + dnum; // send 127(1111111) when fnum is negative, which should not be possible
+    uint16_t output = fixed_9_7_encode(fnum); // see fixed_point.hpp
 
     byte* number = (byte*)malloc(2*sizeof(byte));
     number[0] = (byte) output;
@@ -1169,20 +1127,7 @@ byte* float_2_bytes_2decimals(float fnum)
 }
 
 float bytes_2_float_2decimals(byte * myBytes){
-  float welit = 0;
-  byte mask_decimal = B01111111;
-  byte mask_int = B10000000;
-  // get decimal part of the number
-  byte decimal = myBytes[1] & mask_decimal;
-  int decimal_int = decimal;
-
-  // get integer part of the number
-  byte split_int = (myBytes[1] & mask_int) >> 7;
-  int integer = (myBytes[0] << 1) + split_int;
-
-  welit = integer + decimal_int/100.0;
-  
-  return welit;
+  return fixed_9_7_decode((uint16_t)(((uint16_t)myBytes[0] << 8) | myBytes[1]));
 }
 
 //Return -1 if askedLux < offset
@@ -0,0 +1,109 @@
+#ifndef FIXED_POINT_HPP
+#define FIXED_POINT_HPP
+
+// /*
+// Codec of the 2-byte fixed-point numbers exchanged by the hub, the desks and the server.
+// It is plain C++11 without the standard library, so the Arduino sketches include it too: the copies in
+// hub_code/ and ../Project/controller/ must stay equal to this file (make sync_codec copies it).
+// */
+
+#include <stdint.h>
+
+/*
+ * 12.4 format, sent by the hub to the server and by the server to the hub
+ *
+ * The 12 most significative bits hold the integer part, 0:4095
+ * The 4 less significative bits hold the decimal part in tenths, 0:9
+ * 15 in the decimal part marks an invalid read, and it is what a negative number is encoded to
+ */
+#define FIXED_12_4_LIMIT 4095.95 // numbers from here on are sent as the maximum, 4095.9
+#define FIXED_12_4_MAX 4095.9
+#define FIXED_12_4_INVALID 15
+#define FIXED_12_4_INVALID_VALUE 0.15 // what an invalid read decodes to
+
+/*
+ * 9.7 format, used by the consensus over the CAN bus, with 2 decimals
+ *
+ * The 9 most significative bits hold the integer part, 0:511
+ * The 7 less significative bits hold the decimal part in hundredths, 0:99
+ */
+#define FIXED_9_7_LIMIT 511.995
+#define FIXED_9_7_MAX 511.99
+#define FIXED_9_7_INVALID 127
+
+inline uint16_t fixed_12_4_encode(float fnum)
+{
+    if (fnum < 0)
+    {
+        return FIXED_12_4_INVALID; // should not be possible
+    }
+    if (!(fnum < FIXED_12_4_LIMIT)) // also NaN
+    {
+        fnum = FIXED_12_4_MAX;
+    }
+
+    uint16_t inum = (uint16_t)fnum;                                   // integer part
+    uint8_t dnum = (uint8_t)((double)(10 * (fnum - inum)) + 0.5); // decimal part, rounded half up
+
+    // increments one when the decimal part rounds up
+    if (dnum == 10)
+    {
+        dnum = 0;
+        inum++;
+    }
+    return (uint16_t)((inum << 4) + dnum);
+}
+
+/*
+ * Decodes without branches: the decimal part indexes a table with its value and with the weight of the integer part,
+ * which is 0 for an invalid read
+ */
+inline float fixed_12_4_decode(uint16_t raw)
+{
+    static constexpr double tenths[16] = {0 * 0.1, 1 * 0.1, 2 * 0.1, 3 * 0.1, 4 * 0.1, 5 * 0.1, 6 * 0.1, 7 * 0.1,
+                                          8 * 0.1, 9 * 0.1, 10 * 0.1, 11 * 0.1, 12 * 0.1, 13 * 0.1, 14 * 0.1, FIXED_12_4_INVALID_VALUE};
+    static constexpr uint8_t integer_weight[16] = {1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 0};
+
+    uint8_t decimal = raw & 0xF;
+    return (float)((double)((raw >> 4) * integer_weight[decimal]) + tenths[decimal]);
+}
+
+inline bool fixed_12_4_is_invalid(uint16_t raw)
+{
+    return (raw & 0xF) == FIXED_12_4_INVALID;
+}
+
+// the most significative byte is sent first
+inline uint16_t fixed_12_4_from_bytes(uint8_t most_significative, uint8_t less_significative)
+{
+    return (uint16_t)(((uint16_t)most_significative << 8) | less_significative); // int has 16 bits on the Arduino
+}
+
+inline uint16_t fixed_9_7_encode(float fnum)
+{
+    if (fnum < 0)
+    {
+        return FIXED_9_7_INVALID; // should not be possible
+    }
+    if (!(fnum < FIXED_9_7_LIMIT))
+    {
+        fnum = FIXED_9_7_MAX;
+    }
+
+    uint16_t inum = (uint16_t)fnum;
+    uint8_t dnum = (uint8_t)((double)(100 * (fnum - inum)) + 0.5);
+
+    if (dnum == 100)
+    {
+        dnum = 0;
+        inum++;
+    }
+    return (uint16_t)((inum << 7) + dnum);
+}
+
+inline float fixed_9_7_decode(uint16_t raw)
+{
+    return (float)((raw >> 7) + (raw & 0x7F) / 100.0);
+}
+
+#endif